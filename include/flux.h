@@ -22,11 +22,38 @@
 #define SKELTOOLS_FLUX_H
 
 #include <utility>
+#include <string>
+#include <vector>
 #include <itkImage.h>
 #include <itkVector.h>
 #include <itkLogger.h>
+#include "itkSeparableDistanceMapImageFilter.h"
 
 #include "itkCommandLineArgumentParser.h"
+#include "itkLazyAverageOutwardFlux.h"
+
+/// Binary object (inside 1, outside 0) from -input after -spacing, -smooth and -lthreshold/-uthreshold.
+/// Smoothing is done in TInternalImage.
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger);
+
+/// Same as above for the object in inputFilename (e.g. one frame of a time series).
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const std::string &inputFilename,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger);
+
+/// Same as above for readRegion of the file only (an empty region reads everything).
+/// The returned image starts at index 0 with the physical origin of readRegion.
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const std::string &inputFilename,
+                   const typename TObjectImage::RegionType &readRegion,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger);
 
 template<class TObjectImage, class TDistanceImage>
 std::pair< typename TDistanceImage::Pointer,
@@ -34,5 +61,72 @@ std::pair< typename TDistanceImage::Pointer,
 computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Pointer &parser,
                                       const itk::Logger::Pointer &logger);
 
+/// Same as above for an already segmented object image (object voxels >= 1), e.g. after
+/// hole filling or resampling, so that distance and spokes match the object being thinned.
+template<class TObjectImage, class TDistanceImage>
+std::pair< typename TDistanceImage::Pointer,
+        typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
+computeObjectSignedDistanceSpokesPair(const typename TObjectImage::Pointer &objectImage,
+                                      const itk::Logger::Pointer &logger);
+
+/// Signed distance (object negative) and spokes of an inverted object (object voxels 0).
+template<class TObjectImage, class TDistanceImage>
+std::pair< typename TDistanceImage::Pointer,
+        typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
+computeSignedDistanceSpokesPair(const typename TObjectImage::Pointer &invertedObject, double maxSpacing,
+                                const itk::Logger::Pointer &logger);
+
+/// Updated signed exact distance filter (object negative) of an object image (object
+/// voxels >= 1), its vector distance map is the closest point transform.
+template<class TObjectImage, class TDistanceImage>
+typename itk::SeparableDistanceMapImageFilter<TObjectImage, TDistanceImage>::Pointer
+computeObjectSignedDistanceMap(const typename TObjectImage::Pointer &objectImage);
+
+/// Signed distance (object negative) and AOF of an object image (object voxels >= 1).
+/// The AOF is computed from the closest point transform directly, tile by tile, without
+/// the float spoke field of computeObjectSignedDistanceSpokesPair (same values), or with
+/// -divergence from the distance only.
+template<class TObjectImage, class TDistanceImage>
+std::pair<typename TDistanceImage::Pointer, typename TDistanceImage::Pointer>
+computeObjectSignedDistanceAOFPair(const typename TObjectImage::Pointer &objectImage,
+                                   const itk::CommandLineArgumentParser::Pointer &parser,
+                                   const itk::Logger::Pointer &logger);
+
+/// Signed distance (object negative) and a lazy AOF of an object image (-lazyaof): only the
+/// closest point transform is computed, the AOF is evaluated where it is read, with the values
+/// of computeObjectSignedDistanceAOFPair.
+template<class TObjectImage, class TDistanceImage>
+std::pair<typename TDistanceImage::Pointer, typename itk::LazyAverageOutwardFlux<TObjectImage::ImageDimension>::Pointer>
+computeObjectSignedDistanceLazyAOFPair(const typename TObjectImage::Pointer &objectImage,
+                                       const itk::CommandLineArgumentParser::Pointer &parser,
+                                       const itk::Logger::Pointer &logger);
+
+/// Fast AOF approximation (-divergence): flux from the divergence of the normalized gradient of
+/// a signed distance (inside negative), see DivergenceOutwardFluxImageFilter.
+template<class TDistanceImage>
+typename TDistanceImage::Pointer
+computeDivergenceAOF(const typename TDistanceImage::Pointer &signedDistance,
+                     const itk::Logger::Pointer &logger);
+
+/// Shell radii of -shells r1 r2 .. (voxels), {1} by default.
+std::vector<double>
+getAOFShellRadii(const itk::CommandLineArgumentParser::Pointer &parser,
+                 const itk::Logger::Pointer &logger);
+
+/// AOF thresholds of the command line an -adaptive AOF has to be exact near: the -approximate
+/// cut off, or 0 (quick mode) and the anchor thresholds. Empty without -adaptive, or with
+/// -writeAnchorMap which reads the exact AOF.
+std::vector<double>
+getAdaptiveAOFThresholds(const itk::CommandLineArgumentParser::Pointer &parser,
+                         const itk::Logger::Pointer &logger);
+
+/// Apply the AOF options of the command line (-samples N, -shells r1 r2 .., -adaptive [Z]) to an
+/// AOF filter (or lazy AOF).
+template<class TAOFFilter>
+void
+configureAOFFilter(TAOFFilter *aofFilter,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger);
+
 #include "flux.hxx"
 #endif //SKELTOOLS_FLUX_H
@@ -22,6 +22,7 @@
 #define SKELTOOLS_FLUX_HXX
 
 #include <utility>
+#include <algorithm>
 #include <sstream>
 #include <vector>
 
@@ -29,39 +30,59 @@
 #include <itkLogger.h>
 #include <itkImageFileReader.h>
 #include <itkChangeInformationImageFilter.h>
+#include <itkRegionOfInterestImageFilter.h>
 #include <itkDiscreteGaussianImageFilter.h>
 #include <itkBinaryThresholdImageFilter.h>
-#include <itkSignedDanielssonDistanceMapImageFilter.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
 
 #include "itkCommandLineArgumentParser.h"
+#include "itkSpokeFieldToAverageOutwardFluxImageFilter.h"
+#include "itkDivergenceOutwardFluxImageFilter.h"
+#include "itkLazyAverageOutwardFlux.h"
+#include "itkSeparableDistanceMapImageFilter.h"
 
 
-template<class TObjectImage, class TDistanceImage>
-std::pair< typename TDistanceImage::Pointer,
-           typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
-computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Pointer &parser,
-                                      const itk::Logger::Pointer &logger){
-    logger->Info("Starting computation of Distance map + spoke vector field\n");
-    static_assert(TObjectImage::ImageDimension == TDistanceImage::ImageDimension);
-    using ObjectImageType = TObjectImage;
-    using DistanceImageType = TDistanceImage;
-    using InternalImageType = DistanceImageType;
-    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
-    using FieldImageType = itk::Image<itk::Vector<float,Dimension>, Dimension>;
-
-
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger){
     std::string  inputFilename;
     if (!parser->GetCommandLineArgument("-input", inputFilename)) {
         logger->Error("Input file not specified\n");
-        return {};
-    }else{
-        logger->Info("Set input object filename to : " + inputFilename + "\n" );
+        return nullptr;
     }
+    return computeObjectImage<TObjectImage, TInternalImage>(inputFilename, parser, logger);
+}
+
+
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const std::string &inputFilename,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger){
+    return computeObjectImage<TObjectImage, TInternalImage>(inputFilename, typename TObjectImage::RegionType(),
+                                                            parser, logger);
+}
+
+
+template<class TObjectImage, class TInternalImage>
+typename TObjectImage::Pointer
+computeObjectImage(const std::string &inputFilename,
+                   const typename TObjectImage::RegionType &readRegion,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger){
+    static_assert(TObjectImage::ImageDimension == TInternalImage::ImageDimension);
+    using ObjectImageType = TObjectImage;
+    using InternalImageType = TInternalImage;
+    using PixelType = typename ObjectImageType::PixelType;
+    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
+
+    logger->Info("Set input object filename to : " + inputFilename + "\n" );
 
     using ReaderType = itk::ImageFileReader<ObjectImageType>;
     auto reader = ReaderType::New();
     reader->SetFileName(inputFilename);
-    reader->Update();
 
     std::vector<float> objectSpacing(Dimension,1);
     if(parser->GetCommandLineArgument("-spacing",objectSpacing)){
@@ -89,6 +110,15 @@ computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Poin
     changeSpacing->ChangeSpacingOn();
     typename ObjectImageType::Pointer image = changeSpacing->GetOutput();
 
+    // only the requested part of the file is read when the image IO supports streaming.
+    using RegionOfInterestFilterType = itk::RegionOfInterestImageFilter<ObjectImageType, ObjectImageType>;
+    auto regionOfInterestFilter = RegionOfInterestFilterType::New();
+    if (readRegion.GetNumberOfPixels() > 0) {
+        regionOfInterestFilter->SetInput(changeSpacing->GetOutput());
+        regionOfInterestFilter->SetRegionOfInterest(readRegion);
+        image = regionOfInterestFilter->GetOutput();
+    }
+
     using GaussianFilterType = itk::DiscreteGaussianImageFilter<ObjectImageType , InternalImageType >;
     typename GaussianFilterType::Pointer smoothingFilter = GaussianFilterType::New();
     smoothingFilter->SetInput(image);
@@ -132,15 +162,70 @@ computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Poin
     }
 
     thresholdFilter->SetUpperThreshold(uthresh);
-    thresholdFilter->SetOutsideValue(1);
-    thresholdFilter->SetInsideValue(0);
+    thresholdFilter->SetOutsideValue(itk::NumericTraits<PixelType>::ZeroValue());
+    thresholdFilter->SetInsideValue(itk::NumericTraits<PixelType>::OneValue());
     thresholdFilter->SetInput(smoothingFilter->GetOutput());
+    thresholdFilter->Update();
+    return thresholdFilter->GetOutput();
+}
+
+
+template<class TObjectImage, class TDistanceImage>
+std::pair< typename TDistanceImage::Pointer,
+           typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
+computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Pointer &parser,
+                                      const itk::Logger::Pointer &logger){
+    logger->Info("Starting computation of Distance map + spoke vector field\n");
+    auto objectImage = computeObjectImage<TObjectImage, TDistanceImage>(parser, logger);
+    if (objectImage == nullptr) {
+        return {};
+    }
+    return computeObjectSignedDistanceSpokesPair<TObjectImage, TDistanceImage>(objectImage, logger);
+}
+
+
+template<class TObjectImage, class TDistanceImage>
+std::pair< typename TDistanceImage::Pointer,
+           typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
+computeObjectSignedDistanceSpokesPair(const typename TObjectImage::Pointer &objectImage,
+                                      const itk::Logger::Pointer &logger){
+    logger->Info("Starting computation of Distance map + spoke vector field from object image\n");
+    using ObjectImageType = TObjectImage;
+    using PixelType = typename ObjectImageType::PixelType;
+
+    // the distance computation expects the object as background.
+    using InvertFilterType = itk::BinaryThresholdImageFilter< ObjectImageType , ObjectImageType >;
+    typename InvertFilterType::Pointer invertFilter = InvertFilterType::New();
+    invertFilter->SetInput(objectImage);
+    invertFilter->SetLowerThreshold(itk::NumericTraits<PixelType>::OneValue());
+    invertFilter->SetUpperThreshold(itk::NumericTraits<PixelType>::max());
+    invertFilter->SetOutsideValue(itk::NumericTraits<PixelType>::OneValue());
+    invertFilter->SetInsideValue(itk::NumericTraits<PixelType>::ZeroValue());
+    invertFilter->Update();
+
+    auto spacing = objectImage->GetSpacing();
+    double maxSpacing = *std::max_element(spacing.Begin(), spacing.End());
+    return computeSignedDistanceSpokesPair<ObjectImageType, TDistanceImage>(
+            invertFilter->GetOutput(), maxSpacing, logger);
+}
+
+
+template<class TObjectImage, class TDistanceImage>
+std::pair< typename TDistanceImage::Pointer,
+           typename itk::Image<itk::Vector<float, TObjectImage::ImageDimension>,TObjectImage::ImageDimension>::Pointer>
+computeSignedDistanceSpokesPair(const typename TObjectImage::Pointer &invertedObject, double maxSpacing,
+                                const itk::Logger::Pointer &logger){
+    static_assert(TObjectImage::ImageDimension == TDistanceImage::ImageDimension);
+    using ObjectImageType = TObjectImage;
+    using DistanceImageType = TDistanceImage;
+    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
+    using FieldImageType = itk::Image<itk::Vector<float,Dimension>, Dimension>;
 
     logger->Info("Started Signed distance map computation \n");
-    using SignedDistanceMapImageFilterType = itk::SignedDanielssonDistanceMapImageFilter<ObjectImageType, DistanceImageType>;
+    using SignedDistanceMapImageFilterType = itk::SeparableDistanceMapImageFilter<ObjectImageType, DistanceImageType>;
     typename SignedDistanceMapImageFilterType::Pointer distanceMapImageFilter = SignedDistanceMapImageFilterType::New();
-    distanceMapImageFilter->SetInput(thresholdFilter->GetOutput());
-    // inside true because threshold inverts the object.
+    distanceMapImageFilter->SetInput(invertedObject);
+    // inside true because the object is inverted.
     distanceMapImageFilter->SetInsideIsPositive(true);
     distanceMapImageFilter->Update();
     typename DistanceImageType::Pointer distanceMap = distanceMapImageFilter->GetOutput();
@@ -158,8 +243,6 @@ computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Poin
     itk::ImageRegionConstIterator<OffSetImageType> cpit(closestPointTransform, closestPointTransform->GetLargestPossibleRegion());
     typename FieldImageType::PixelType castValue;
 
-    double maxSpacing = *std::max_element(objectSpacing.begin(),objectSpacing.end());
-
     dit.GoToBegin();
     wit.GoToBegin();
     cpit.GoToBegin();
@@ -182,4 +265,174 @@ computeObjectSignedDistanceSpokesPair(const itk::CommandLineArgumentParser::Poin
     retVal.second = castField;
     return retVal;
 }
+
+template<class TObjectImage, class TDistanceImage>
+typename itk::SeparableDistanceMapImageFilter<TObjectImage, TDistanceImage>::Pointer
+computeObjectSignedDistanceMap(const typename TObjectImage::Pointer &objectImage){
+    using ObjectImageType = TObjectImage;
+    using DistanceImageType = TDistanceImage;
+    using PixelType = typename ObjectImageType::PixelType;
+
+    // the distance computation expects the object as background.
+    using InvertFilterType = itk::BinaryThresholdImageFilter< ObjectImageType , ObjectImageType >;
+    typename InvertFilterType::Pointer invertFilter = InvertFilterType::New();
+    invertFilter->SetInput(objectImage);
+    invertFilter->SetLowerThreshold(itk::NumericTraits<PixelType>::OneValue());
+    invertFilter->SetUpperThreshold(itk::NumericTraits<PixelType>::max());
+    invertFilter->SetOutsideValue(itk::NumericTraits<PixelType>::OneValue());
+    invertFilter->SetInsideValue(itk::NumericTraits<PixelType>::ZeroValue());
+
+    using SignedDistanceMapImageFilterType = itk::SeparableDistanceMapImageFilter<ObjectImageType, DistanceImageType>;
+    typename SignedDistanceMapImageFilterType::Pointer distanceMapImageFilter = SignedDistanceMapImageFilterType::New();
+    distanceMapImageFilter->SetInput(invertFilter->GetOutput());
+    // inside true because the object is inverted.
+    distanceMapImageFilter->SetInsideIsPositive(true);
+    distanceMapImageFilter->Update();
+    return distanceMapImageFilter;
+}
+
+template<class TObjectImage, class TDistanceImage>
+std::pair<typename TDistanceImage::Pointer, typename TDistanceImage::Pointer>
+computeObjectSignedDistanceAOFPair(const typename TObjectImage::Pointer &objectImage,
+                                   const itk::CommandLineArgumentParser::Pointer &parser,
+                                   const itk::Logger::Pointer &logger){
+    using DistanceImageType = TDistanceImage;
+    logger->Info("Starting computation of Distance map + AOF from closest point transform\n");
+
+    auto distanceMapImageFilter = computeObjectSignedDistanceMap<TObjectImage, DistanceImageType>(objectImage);
+    typename DistanceImageType::Pointer distanceMap = distanceMapImageFilter->GetOutput();
+    using OffSetImageType = typename itk::SeparableDistanceMapImageFilter<TObjectImage,
+            DistanceImageType>::VectorImageType;
+
+    if (parser->ArgumentExists("-divergence")) {
+        return {distanceMap, computeDivergenceAOF<DistanceImageType>(distanceMap, logger)};
+    }
+
+    auto spacing = objectImage->GetSpacing();
+    double maxSpacing = *std::max_element(spacing.Begin(), spacing.End());
+
+    // spokes 1.5 voxels from the boundary are zeroed as in computeSignedDistanceSpokesPair.
+    using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter<OffSetImageType,
+            typename DistanceImageType::PixelType>;
+    typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
+    configureAOFFilter(aofFilter.GetPointer(), parser, logger);
+    aofFilter->SetInput(distanceMapImageFilter->GetVectorDistanceMap());
+    aofFilter->SetDistanceImage(distanceMap);
+    aofFilter->SetSpokeDistanceThreshold(-1.5 * maxSpacing);
+    aofFilter->Update();
+    return {distanceMap, aofFilter->GetOutput()};
+}
+
+template<class TObjectImage, class TDistanceImage>
+std::pair<typename TDistanceImage::Pointer, typename itk::LazyAverageOutwardFlux<TObjectImage::ImageDimension>::Pointer>
+computeObjectSignedDistanceLazyAOFPair(const typename TObjectImage::Pointer &objectImage,
+                                       const itk::CommandLineArgumentParser::Pointer &parser,
+                                       const itk::Logger::Pointer &logger){
+    using DistanceImageType = TDistanceImage;
+    using LazyAOFType = itk::LazyAverageOutwardFlux<TObjectImage::ImageDimension>;
+    logger->Info("Starting computation of Distance map + closest point transform, AOF evaluated on demand\n");
+
+    auto distanceMapImageFilter = computeObjectSignedDistanceMap<TObjectImage, DistanceImageType>(objectImage);
+    auto spacing = objectImage->GetSpacing();
+    double maxSpacing = *std::max_element(spacing.Begin(), spacing.End());
+
+    // same gating as computeObjectSignedDistanceAOFPair.
+    typename LazyAOFType::Pointer lazyAOF = LazyAOFType::New();
+    configureAOFFilter(lazyAOF.GetPointer(), parser, logger);
+    lazyAOF->SetDistanceImage(distanceMapImageFilter->GetOutput());
+    lazyAOF->SetSpokeDistanceThreshold(-1.5 * maxSpacing);
+    lazyAOF->SetClosestPointTransform(distanceMapImageFilter->GetVectorDistanceMap());
+    return {distanceMapImageFilter->GetOutput(), lazyAOF};
+}
+
+template<class TDistanceImage>
+typename TDistanceImage::Pointer
+computeDivergenceAOF(const typename TDistanceImage::Pointer &signedDistance,
+                     const itk::Logger::Pointer &logger){
+    logger->Info("Approximating AOF by the divergence of the normalized distance gradient\n");
+    using DivergenceFilterType = itk::DivergenceOutwardFluxImageFilter<TDistanceImage, TDistanceImage>;
+    typename DivergenceFilterType::Pointer divergenceFilter = DivergenceFilterType::New();
+    divergenceFilter->SetInput(signedDistance);
+    divergenceFilter->Update();
+    return divergenceFilter->GetOutput();
+}
+
+inline std::vector<double>
+getAOFShellRadii(const itk::CommandLineArgumentParser::Pointer &parser,
+                 const itk::Logger::Pointer &logger){
+    std::vector<double> radii;
+    if (parser->GetCommandLineArgument("-shells", radii) && !radii.empty()) {
+        if (*std::min_element(radii.begin(), radii.end()) > 0) {
+            return radii;
+        }
+        logger->Warning("Ignoring -shells, radii must be positive\n");
+    }
+    return {1.0};
+}
+
+inline std::vector<double>
+getAdaptiveAOFThresholds(const itk::CommandLineArgumentParser::Pointer &parser,
+                         const itk::Logger::Pointer &logger){
+    if (!parser->ArgumentExists("-adaptive")) return {};
+    if (parser->ArgumentExists("-writeAnchorMap")) {
+        logger->Warning("Ignoring -adaptive, the anchor threshold map needs exact AOF values\n");
+        return {};
+    }
+    if (parser->ArgumentExists("-approximate")) {
+        // lower threshold of the approximate medial surface.
+        double aofThresholdValue = 0.4;
+        parser->GetCommandLineArgument("-approximate", aofThresholdValue);
+        return {-40 * aofThresholdValue};
+    }
+    // quick mode keeps negative AOF, the anchors compare against -threshold and -curveThreshold.
+    std::vector<double> thresholds{0.0};
+    double threshold;
+    if (parser->GetCommandLineArgument("-threshold", threshold)) {
+        thresholds.push_back(threshold);
+    } else {
+        thresholds.push_back(-10);
+        thresholds.push_back(-30);
+    }
+    if (parser->GetCommandLineArgument("-curveThreshold", threshold)) {
+        thresholds.push_back(threshold);
+    } else if (parser->ArgumentExists("-cascade")) {
+        thresholds.push_back(-30);
+    }
+    return thresholds;
+}
+
+template<class TAOFFilter>
+void
+configureAOFFilter(TAOFFilter *aofFilter,
+                   const itk::CommandLineArgumentParser::Pointer &parser,
+                   const itk::Logger::Pointer &logger){
+    int numberOfSamples = 0;
+    if (parser->GetCommandLineArgument("-samples", numberOfSamples)) {
+        if (numberOfSamples <= 0) {
+            logger->Warning("Ignoring invalid -samples " + std::to_string(numberOfSamples) + "\n");
+        } else {
+            logger->Debug("AOF sphere samples : " + std::to_string(numberOfSamples) + "\n");
+            aofFilter->SetNumberOfSamples(numberOfSamples);
+        }
+    }
+    auto radii = getAOFShellRadii(parser, logger);
+    if (radii.size() != 1 || radii[0] != 1.0) {
+        std::stringstream ss;
+        for (double radius: radii) ss << " " << radius;
+        logger->Debug("AOF shell radii :" + ss.str() + "\n");
+    }
+    aofFilter->SetShellRadii(radii);
+
+    auto thresholds = getAdaptiveAOFThresholds(parser, logger);
+    if (!thresholds.empty()) {
+        double confidence = 3.0;
+        parser->GetCommandLineArgument("-adaptive", confidence);
+        std::stringstream ss;
+        for (double threshold: thresholds) ss << " " << threshold;
+        logger->Info("Adaptive AOF sampling, exact near" + ss.str() + " (" + std::to_string(confidence) +
+                     " standard errors)\n");
+        aofFilter->SetAdaptiveThresholds(thresholds);
+        aofFilter->SetAdaptiveConfidence(confidence);
+    }
+}
 #endif //SKELTOOLS_FLUX_HXX
@@ -51,7 +51,7 @@ namespace itk {
         AOFAnchoredMedialCurveImageFilter() = default;
         ~AOFAnchoredMedialCurveImageFilter() = default;
 
-        bool IsEnd(IndexType index) override;
+        bool IsTopologicalEnd(IndexType index) override;
         bool IsSimple(IndexType index) override;
         bool IsBoundary(IndexType index) override;
 
@@ -30,8 +30,8 @@ namespace itk {
     }
 
     template<class TInputImage, class TOutputImage>
-    bool AOFAnchoredMedialCurveImageFilter<TInputImage, TOutputImage>::IsEnd(IndexType index) {
-        return ::topology::IsEndPoint<TOutputImage>(this->m_Skeleton, index) && this->m_AOF->GetPixel(index) < this->m_AOFThreshold;
+    bool AOFAnchoredMedialCurveImageFilter<TInputImage, TOutputImage>::IsTopologicalEnd(IndexType index) {
+        return ::topology::IsEndPoint<TOutputImage>(this->m_Skeleton, index);
     }
 
     template<class TInputImage, class TOutputImage>
@@ -49,7 +49,7 @@ namespace itk {
         AOFAnchoredMedialSurfaceImageFilter();
         ~AOFAnchoredMedialSurfaceImageFilter() = default;
 
-        bool IsEnd(IndexType index) override;
+        bool IsTopologicalEnd(IndexType index) override;
         bool IsSimple(IndexType index) override;
         bool IsBoundary(IndexType index) override;
 
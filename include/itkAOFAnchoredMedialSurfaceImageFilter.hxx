@@ -36,8 +36,8 @@ namespace itk {
     }
 
     template<class TInputImage, class TOutputImage>
-    bool AOFAnchoredMedialSurfaceImageFilter<TInputImage, TOutputImage>::IsEnd(IndexType index) {
-        return ::topology::IsEdgePoint<TOutputImage>(this->m_Skeleton, index) && this->m_AOF->GetPixel(index) < this->m_AOFThreshold;
+    bool AOFAnchoredMedialSurfaceImageFilter<TInputImage, TOutputImage>::IsTopologicalEnd(IndexType index) {
+        return ::topology::IsEdgePoint<TOutputImage>(this->m_Skeleton, index);
     }
 
     template<class TInputImage, class TOutputImage>
@@ -23,12 +23,13 @@
 #include <queue>
 
 #include "itkOrderedSkeletonizationImageFilterBase.h"
+#include "itkLazyAverageOutwardFlux.h"
 
 #include <itkImageToImageFilter.h>
 #include <itkImageRegionConstIterator.h>
 #include <itkImageRegionIterator.h>
 #include <itkNeighborhoodIterator.h>
-#include <itkDanielssonDistanceMapImageFilter.h>
+#include "itkSeparableDistanceMapImageFilter.h"
 #include <itkConstantBoundaryCondition.h>
 
 namespace itk {
@@ -40,7 +41,7 @@ namespace itk {
     public:
         /** Standard class typedefs. */
         using Self = AOFAnchoredSkeletonImageFilterBase;
-        using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+        using Superclass = OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>;
         using Pointer = SmartPointer<Self>;
         using ConstPointer = SmartPointer<const Self>;
 
@@ -55,6 +56,7 @@ namespace itk {
 
         using PixelType = typename TInputImage::PixelType;
         using OutputIteratorType = ImageRegionIterator<TOutputImage>;
+        using InputConstIteratorType = ImageRegionConstIterator<TInputImage>;
 
         using AOFValueType = float;
         using AOFImageType = Image<AOFValueType, Dimension>;
@@ -74,21 +76,65 @@ namespace itk {
             return m_AOF;
         }
 
+        using LazyAOFType = LazyAverageOutwardFlux<Dimension>;
+        using LazyAOFPointerType = typename LazyAOFType::Pointer;
+
+        /// Alternative to SetAOFImage: the AOF is evaluated (and memoised) from spokes only at the
+        /// voxels the anchor test reads, instead of being computed for the whole volume upfront.
+        /// Quick mode is not applied with a lazy AOF.
+        void SetLazyAOF(LazyAOFType *lazyAOF){
+            m_LazyAOF = lazyAOF;
+            this->Modified();
+        }
+        LazyAOFType *GetLazyAOF(){
+            return m_LazyAOF;
+        }
+
         itkSetMacro(AOFThreshold, AOFValueType);
         itkGetConstMacro(AOFThreshold, AOFValueType);
 
+        /// Initialize with the interior voxels of negative AOF only. Ignored with a lazy AOF,
+        /// which would otherwise be evaluated at every interior voxel: the AOF is then only read
+        /// by the anchor test and the skeleton is the one of the default (non quick) mode.
 		itkSetMacro(Quick, bool);
         itkGetConstMacro(Quick, bool);
 
+        /// Approximate, for every object voxel, the AOF threshold below which it stays in the
+        /// skeleton, so {voxels with value < T} approximates the skeleton at T <= AOFThreshold.
+        /// Only the skeleton of this run is peeled, end points in decreasing threshold order;
+        /// voxels thinned at AOFThreshold hold max and voxels kept at every threshold lowest.
+        /// A run at a lower T has fewer anchors and thins in distance order from the start, so
+        /// it can keep or remove other voxels than {value < T}; rerun for an exact skeleton.
+        /// Peeled voxels are ranked in the same order after the thinned ones (ComputeRemovalRank).
+        itkSetMacro(ComputeApproximateAnchorThreshold, bool);
+        itkGetConstMacro(ComputeApproximateAnchorThreshold, bool);
+        itkBooleanMacro(ComputeApproximateAnchorThreshold);
+        AOFImagePointerType GetApproximateAnchorThresholdImage(){
+            return m_ApproximateAnchorThreshold;
+        }
+
     protected:
         AOFAnchoredSkeletonImageFilterBase();
         ~AOFAnchoredSkeletonImageFilterBase() = default;
 
 		void Initialize() override;
+        void FinalizeThinning() override;
+
+        /// End point (curve) or edge point (surface) before the AOF anchor test.
+        virtual bool IsTopologicalEnd(IndexType index) = 0;
+        bool IsEnd(IndexType index) override;
+
+        /// AOF at index, from the AOF image or else evaluated lazily.
+        AOFValueType GetAOF(const IndexType &index) {
+            return m_AOF ? m_AOF->GetPixel(index) : m_LazyAOF->Evaluate(index);
+        }
 
 		bool m_Quick;
+        bool m_ComputeApproximateAnchorThreshold;
 
         AOFImagePointerType m_AOF;
+        LazyAOFPointerType m_LazyAOF;
+        AOFImagePointerType m_ApproximateAnchorThreshold;
         AOFValueType m_AOFThreshold;
     };
 
@@ -19,6 +19,13 @@
 #ifndef SKELTOOLS_itkAOFAnchoredSkeletonImageFilterBase_hxx
 #define SKELTOOLS_itkAOFAnchoredSkeletonImageFilterBase_hxx
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkMultiThreaderBase.h>
+
 #include "itkAOFAnchoredSkeletonImageFilterBase.h"
 #include "topology.h"
 
@@ -27,77 +34,163 @@ namespace itk {
     AOFAnchoredSkeletonImageFilterBase<TInputImage, TOutputImage>::AOFAnchoredSkeletonImageFilterBase() {
         m_AOFThreshold = -30.0;
         m_AOF = nullptr;
+        m_LazyAOF = nullptr;
+        m_ApproximateAnchorThreshold = nullptr;
 		m_Quick = false;
+        m_ComputeApproximateAnchorThreshold = false;
+    }
+
+    template<class TInputImage, class TOutputImage>
+    bool
+    AOFAnchoredSkeletonImageFilterBase<TInputImage, TOutputImage>::IsEnd(IndexType index) {
+        return this->IsTopologicalEnd(index) && this->GetAOF(index) < m_AOFThreshold;
     }
 
     template<class TInputImage, class TOutputImage>
     void
     AOFAnchoredSkeletonImageFilterBase<TInputImage, TOutputImage>::Initialize() {
-        InputPointerType input = this->GetInput();
-
-        using BinaryImageGeneratorType = BinaryThresholdImageFilter<TInputImage, TInputImage>;
-        typename BinaryImageGeneratorType::Pointer binaryImageGenerator = BinaryImageGeneratorType::New();
-        binaryImageGenerator->SetInput(input);
-        binaryImageGenerator->SetLowerThreshold(NumericTraits<PixelType>::OneValue());
-        binaryImageGenerator->SetUpperThreshold(NumericTraits<PixelType>::max());
-        binaryImageGenerator->SetOutsideValue(NumericTraits<PixelType>::OneValue());
-        binaryImageGenerator->SetInsideValue(NumericTraits<PixelType>::ZeroValue());
-        binaryImageGenerator->Update();
-        auto binaryInput = binaryImageGenerator->GetOutput();
-        PriorityImagePointerType distanceImage = nullptr;
-
-        if(this->m_PriorityImage == nullptr) {
-            using PriorityFilterType = DanielssonDistanceMapImageFilter<TInputImage, PriorityImageType>;
-            auto priorityFilter = PriorityFilterType::New();
-            priorityFilter->SetInput(binaryInput);
-            priorityFilter->UseImageSpacingOn();
-            priorityFilter->Update();
-            this->m_PriorityImage = priorityFilter->GetOutput();
-            this->m_PriorityImage->ReleaseDataFlagOff();
-            distanceImage = this->m_PriorityImage;
-        }else{
-            auto distanceFilter = DanielssonDistanceMapImageFilter<TInputImage, PriorityImageType>::New();
-            distanceFilter->SetInput(binaryInput);
-            distanceFilter->UseImageSpacingOn();
-            distanceFilter->Update();
-            distanceImage = distanceFilter->GetOutput();
+        if (!m_AOF && !m_LazyAOF) {
+            itkExceptionMacro("Either an AOF image or a lazy AOF must be set.");
         }
+        InputPointerType input = this->GetInput();
+        PriorityImagePointerType distanceImage = this->ComputeDistanceImage();
         assert(distanceImage != nullptr && "Distance image cannot be nullptr\n");
 
         this->m_Skeleton = this->GetOutput();
         this->AllocateOutputs();
 
-        this->m_Queued = TOutputImage::New();
-        this->m_Queued->SetSpacing(this->m_PriorityImage->GetSpacing());
-        this->m_Queued->SetOrigin(this->m_PriorityImage->GetOrigin());
-        this->m_Queued->SetRegions(this->m_PriorityImage->GetRequestedRegion());
-        this->m_Queued->Allocate();
-
-        OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetLargestPossibleRegion());
-        PriorityImageConstIteratorType dIt(distanceImage, distanceImage->GetLargestPossibleRegion() );
-		AOFImageConstIteratorType aofIt(m_AOF, m_AOF->GetLargestPossibleRegion() );
-
-		aofIt.GoToBegin();
-        dIt.GoToBegin();
-        skit.GoToBegin();
-        while (!skit.IsAtEnd()) {
-            PriorityValueType value = dIt.Get();
-            if(value > 0 ){
-				if(!m_Quick ||
-				   (m_Quick && aofIt.Get() < 0)) {
-					if(this->m_RadiusWeightedSkeleton) {
-						skit.Set(value);
-					}else{
-						skit.Set(1);
-					}
-				}
-            }else{
-                skit.Set(0);
+        using RegionType = typename TOutputImage::RegionType;
+        using OutputIteratorWithIndexType = ImageRegionIteratorWithIndex<TOutputImage>;
+
+        // the quick test reads the AOF of every interior voxel, with a lazy AOF it is left to the anchor test.
+        const bool quick = m_Quick && !m_LazyAOF;
+        if (m_Quick && m_LazyAOF) {
+            itkDebugMacro("Quick mode ignored with a lazy AOF, initializing with all interior points");
+        }
+
+        // skeleton voxels are gathered as buffer offsets per slab of the slowest dimension, slabs
+        // are fixed up front and concatenated in order so the heap is seeded exactly as by a full scan.
+        const RegionType largest = this->m_Skeleton->GetLargestPossibleRegion();
+        MultiThreaderBase *multiThreader = this->GetMultiThreader();
+        const SizeValueType slices = largest.GetSize(Dimension - 1);
+        const SizeValueType numberOfChunks =
+                std::max<SizeValueType>(1, std::min<SizeValueType>(slices, 4 * multiThreader->GetNumberOfWorkUnits()));
+        std::vector<std::vector<OffsetValueType>> chunks(numberOfChunks);
+        multiThreader->ParallelizeArray(0, numberOfChunks, [&](SizeValueType c) {
+            const SizeValueType first = slices * c / numberOfChunks;
+            const SizeValueType last = slices * (c + 1) / numberOfChunks;
+            if (first == last) return;
+            RegionType region = largest;
+            region.SetIndex(Dimension - 1, largest.GetIndex(Dimension - 1) + static_cast<IndexValueType>(first));
+            region.SetSize(Dimension - 1, last - first);
+            OutputIteratorWithIndexType skit(this->m_Skeleton, region);
+            InputConstIteratorType inIt(input, region);
+            PriorityImageConstIteratorType dIt(distanceImage, region);
+            for (; !skit.IsAtEnd(); ++skit, ++inIt, ++dIt) {
+                PriorityValueType value = dIt.Get();
+                if (inIt.Get() >= NumericTraits<PixelType>::OneValue() && value > 0 &&
+                    (!quick || this->GetAOF(skit.GetIndex()) < 0 || this->IsProtected(skit.GetIndex()))) {
+                    skit.Set(this->m_RadiusWeightedSkeleton ? value : 1);
+                    chunks[c].push_back(this->m_Skeleton->ComputeOffset(skit.GetIndex()));
+                } else {
+                    skit.Set(0);
+                }
+            }
+        }, nullptr);
+
+        // boundary subset, in parallel over the now complete skeleton, in place.
+        multiThreader->ParallelizeArray(0, numberOfChunks, [&](SizeValueType c) {
+            auto &chunk = chunks[c];
+            chunk.erase(std::remove_if(chunk.begin(), chunk.end(), [&](OffsetValueType offset) {
+                return !this->IsBoundary(this->m_Skeleton->ComputeIndex(offset));
+            }), chunk.end());
+        }, nullptr);
+
+        SizeValueType numberOfCandidates = 0;
+        for (const auto &chunk: chunks) numberOfCandidates += chunk.size();
+        this->m_BoundaryCandidates.clear();
+        this->m_BoundaryCandidates.reserve(numberOfCandidates);
+        for (auto &chunk: chunks) {
+            this->m_BoundaryCandidates.insert(this->m_BoundaryCandidates.end(), chunk.begin(), chunk.end());
+            std::vector<OffsetValueType>().swap(chunk);
+        }
+        this->m_HasBoundaryCandidates = true;
+        itkDebugMacro("Gathered " << numberOfCandidates << " boundary candidates");
+
+        this->InitializeQueued();
+        if (m_LazyAOF) {
+            itkDebugMacro("Lazy AOF evaluated at " << m_LazyAOF->GetNumberOfEvaluations() << " voxels during initialization");
+        }
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    AOFAnchoredSkeletonImageFilterBase<TInputImage, TOutputImage>::FinalizeThinning() {
+        m_ApproximateAnchorThreshold = nullptr;
+        if (!m_ComputeApproximateAnchorThreshold) {
+            Superclass::FinalizeThinning();
+            return;
+        }
+        using OutputPixelType = typename TOutputImage::PixelType;
+
+        m_ApproximateAnchorThreshold = AOFImageType::New();
+        m_ApproximateAnchorThreshold->CopyInformation(this->m_Skeleton);
+        m_ApproximateAnchorThreshold->SetRegions(this->m_Skeleton->GetRequestedRegion());
+        m_ApproximateAnchorThreshold->Allocate();
+        m_ApproximateAnchorThreshold->FillBuffer(NumericTraits<AOFValueType>::max());
+
+        // max heap on the threshold below which a voxel goes, starting from the anchors.
+        using Node = std::pair<AOFValueType, IndexType>;
+        auto lower = [](const Node &a, const Node &b) { return a.first < b.first; };
+        std::priority_queue<Node, std::vector<Node>, decltype(lower)> heap(lower);
+        auto level = [this](const IndexType &index, AOFValueType inherited) {
+            return this->IsTopologicalEnd(index) ? std::min(inherited, this->GetAOF(index)) : inherited;
+        };
+
+        OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
+        for (skit.GoToBegin(); !skit.IsAtEnd(); ++skit) {
+            if (skit.Get() == 0) continue;
+            const IndexType q = skit.GetIndex();
+            m_ApproximateAnchorThreshold->SetPixel(q, NumericTraits<AOFValueType>::NonpositiveMin());
+            if (!this->IsProtected(q) && this->IsSimple(q)) {
+                heap.emplace(level(q, m_AOFThreshold), q);
+            }
+        }
+
+        typename Superclass::OutputNeighborhoodIteratorType::RadiusType radius;
+        radius.Fill(1);
+        typename Superclass::OutputNeighborhoodIteratorType sknit(radius, this->m_Skeleton,
+                                                                  this->m_Skeleton->GetRequestedRegion());
+        std::vector<std::pair<IndexType, OutputPixelType>> peeled;
+        while (!heap.empty()) {
+            const Node node = heap.top();
+            heap.pop();
+            const IndexType q = node.second;
+            if (this->m_Skeleton->GetPixel(q) == 0 || !this->IsSimple(q)) continue;
+            const AOFValueType threshold = level(q, node.first);
+            if (threshold < node.first) {
+                heap.emplace(threshold, q);
+                continue;
             }
-            ++dIt;
-            ++skit;
-			++aofIt;
+
+            peeled.emplace_back(q, this->m_Skeleton->GetPixel(q));
+            m_ApproximateAnchorThreshold->SetPixel(q, threshold);
+            this->RecordRemoval(q);
+            sknit.SetLocation(q);
+            sknit.SetCenterPixel(0);
+            for (unsigned int i = 0; i < sknit.Size(); i++) {
+                if (sknit.GetPixel(i) > 0) {
+                    const IndexType r = sknit.GetIndex(i);
+                    if (!this->IsProtected(r) && this->IsSimple(r)) heap.emplace(level(r, threshold), r);
+                }
+            }
+        }
+        itkDebugMacro("Peeled " << peeled.size() << " skeleton voxels for the anchor threshold map");
+
+        for (const auto &voxel: peeled) {
+            this->m_Skeleton->SetPixel(voxel.first, voxel.second);
         }
+        Superclass::FinalizeThinning();
     }
 
 }
@@ -26,11 +26,13 @@
 #include <itkImageRegionConstIterator.h>
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkSignedDanielssonDistanceMapImageFilter.h>
+#include "itkSeparableDistanceMapImageFilter.h"
 #include <vector>
-#include <random>
 #include <cmath>
 
+#include "sphere.h"
+#include "itkAverageOutwardFluxKernel.h"
+
 
 namespace itk
 {
@@ -62,6 +64,8 @@ template< class TInputImage,
 		itkTypeMacro(AverageOutwardFluxImageFilter, ImageToImageFilter );
 
         using InputPixelType = typename InputImageType::PixelType;
+        using OutputPixelType = typename OutputImageType::PixelType;
+        using OutputImageRegionType = typename Superclass::OutputImageRegionType;
         using IndexType = typename InputImageType::IndexType;
         using OffsetType = typename InputImageType::OffsetType;
         using VectorType = Vector<double, Dimension>;
@@ -70,26 +74,56 @@ template< class TInputImage,
         using BinaryImageType = Image<BinaryPixelType, Dimension>;
         using DistanceImageType = Image<float, Dimension>;
 
-        using SignedDistanceMapImageFilterType = SignedDanielssonDistanceMapImageFilter<BinaryImageType, DistanceImageType>;
+        using SignedDistanceMapImageFilterType = SeparableDistanceMapImageFilter<BinaryImageType, DistanceImageType>;
         using OffSetImageType =  typename SignedDistanceMapImageFilterType::VectorImageType ;
 
         using BoundaryConditionType = itk::ZeroFluxNeumannBoundaryCondition<OffSetImageType>;
+
+        /// Number of sphere samples the flux values are normalized to.
+        static constexpr unsigned ReferenceNumberOfSamples = 60;
+
+        /// Number of deterministic (Fibonacci) sphere directions the flux is sampled at. Default 60.
+        virtual void SetNumberOfSamples(unsigned numberOfSamples);
+        itkGetConstMacro(NumberOfSamples, unsigned);
+
+        /// Radii (in voxels) of the sample spheres the flux is averaged over, default {1}.
+        virtual void SetShellRadii(const std::vector<double> &radii);
+        const std::vector<double> &GetShellRadii() const { return m_ShellRadii; }
+
+        /// Adaptive sampling, see AverageOutwardFluxKernel::SetAdaptive. Values only need to be exact
+        /// near these thresholds on the output (the anchor threshold, the -approximate cut off),
+        /// elsewhere voxels stop early with an estimate on the same side. Default empty: all samples.
+        virtual void SetAdaptiveThresholds(const std::vector<double> &thresholds);
+        const std::vector<double> &GetAdaptiveThresholds() const { return m_AdaptiveThresholds; }
+        /// Standard errors of the adaptive confidence interval, default 3.
+        itkSetMacro(AdaptiveConfidence, double);
+        itkGetConstMacro(AdaptiveConfidence, double);
 	protected:
         AverageOutwardFluxImageFilter();
         ~AverageOutwardFluxImageFilter() = default;
 
+        /// Whole input for the distance transform.
+        void GenerateInputRequestedRegion() override;
+
+        /// Closest point transform of the object, strides of the sample offsets in it and the
+        /// adaptive thresholds.
+        void BeforeThreadedGenerateData() override;
+
         /// \brief Compute the AOF.
-        void GenerateData() override;
+        void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) override;
 
         void PrintSelf(std::ostream& os, Indent indent) const;
         void ComputeInwardFluxOn(){
             m_InwardFlux = true;
         }
 private:
-        void NormalsToASphere();
         void ComputeSpokeField();
 
-        std::vector< VectorType > m_Points;
+        AverageOutwardFluxKernel<Dimension> m_Kernel;
+        unsigned m_NumberOfSamples;
+        std::vector<double> m_ShellRadii;
+        std::vector<double> m_AdaptiveThresholds;
+        double m_AdaptiveConfidence;
         typename DistanceImageType::Pointer m_DistanceMap;
         typename OffSetImageType::Pointer m_ClosestPointTransform;
         BoundaryConditionType m_FieldAccessor;
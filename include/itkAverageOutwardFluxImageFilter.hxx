@@ -22,60 +22,53 @@
 
 #include "itkAverageOutwardFluxImageFilter.h"
 #include <itkBinaryThresholdImageFilter.h>
+#include <algorithm>
 
 namespace itk {
 
     template<class TInputImage, class TOutputImage>
     AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::AverageOutwardFluxImageFilter() {
-        this->NormalsToASphere();
+        this->DynamicMultiThreadingOn();
+        m_ShellRadii = {1.0};
+        m_AdaptiveConfidence = 3.0;
+        m_NumberOfSamples = 0;
+        this->SetNumberOfSamples(ReferenceNumberOfSamples);
         m_InwardFlux = false;
     }
 
     template<class TInputImage, class TOutputImage>
     void
-    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::NormalsToASphere() {
-        ::std::random_device rd;  //Will be used to obtain a seed for the random number engine
-        ::std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-        ::std::uniform_real_distribution<double> dis(0.0, 1.0);
-        constexpr unsigned N = 60;
-        ::std::vector<VectorType> forces;
-        VectorType n;
-        for (size_t d = 0; d < Dimension; ++d) n[d] = 0;
-        forces.push_back(n);
-        n[0] = 1.0;
-        this->m_Points.push_back(n);
-        for (size_t count = 0; count < N - 1; ++count) {
-            for (size_t d = 0; d < Dimension; ++d) {
-                n[d] = dis(gen);
-            }
-            n.Normalize();
-            //hope that no two point are the same.
-            this->m_Points.push_back(n);
-            forces.push_back(0.0 * n);
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::SetNumberOfSamples(unsigned numberOfSamples) {
+        if (numberOfSamples == 0) {
+            itkExceptionMacro("Number of sphere samples must be positive.");
         }
+        if (numberOfSamples == m_NumberOfSamples) return;
+        m_NumberOfSamples = numberOfSamples;
+        m_Kernel.SetSamples(sphere::Samples<Dimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
+
 
-        double r;
-        VectorType forceVector;
-        int iteration = 0;
-        do {
-            for (size_t i = 1; i < N; ++i) {
-                forces[i] *= 0.0;                        // Initialize force vector zero
-                for (size_t j = 0; j < N; ++j) {
-                    if (i == j) continue;
-                    forceVector = this->m_Points[i] - this->m_Points[j];
-                    r = forceVector.GetNorm();
-                    r *= r;
-                    forceVector /= r;
-                    forces[i] += forceVector; // Get contributing forces from other particles.
-                }
-            }
-            for (size_t i = 1; i < N; ++i) {
-                //move point on sphere.
-                this->m_Points[i] += forces[i];
-                this->m_Points[i].Normalize();
-            }
-        } while (++iteration < 50);
-        itkDebugMacro("Finished Computing normals to sphere.");
+    template<class TInputImage, class TOutputImage>
+    void
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::SetShellRadii(const std::vector<double> &radii) {
+        if (radii.empty() || *std::min_element(radii.begin(), radii.end()) <= 0) {
+            itkExceptionMacro("Shell radii must be positive.");
+        }
+        if (radii == m_ShellRadii) return;
+        m_ShellRadii = radii;
+        m_Kernel.SetSamples(sphere::Samples<Dimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
+
+
+    template<class TInputImage, class TOutputImage>
+    void
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::SetAdaptiveThresholds(
+            const std::vector<double> &thresholds) {
+        if (thresholds == m_AdaptiveThresholds) return;
+        m_AdaptiveThresholds = thresholds;
+        this->Modified();
     }
 
 
@@ -106,49 +99,43 @@ namespace itk {
     }
 
 
-    template<class TInputImage, class OutputImageType>
+    template<class TInputImage, class TOutputImage>
+    void
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::GenerateInputRequestedRegion() {
+        Superclass::GenerateInputRequestedRegion();
+        // the distance transform needs the whole object.
+        if (auto input = const_cast<InputImageType *>(this->GetInput())) {
+            input->SetRequestedRegionToLargestPossibleRegion();
+        }
+    }
+
+
+    template<class TInputImage, class TOutputImage>
     void
-    AverageOutwardFluxImageFilter<TInputImage, OutputImageType>::GenerateData() {
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::BeforeThreadedGenerateData() {
         ComputeSpokeField();
+        m_Kernel.ComputeStrides(m_ClosestPointTransform.GetPointer());
+        double scale = static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples();
+        if (m_InwardFlux) scale *= -1;
+        m_Kernel.SetAdaptive(m_AdaptiveThresholds, scale, m_AdaptiveConfidence);
+    }
 
-        auto output = this->GetOutput();
-        const auto input = this->GetInput();
-
-        this->AllocateOutputs();
 
-        auto spacing = input->GetSpacing();
+    template<class TInputImage, class TOutputImage>
+    void
+    AverageOutwardFluxImageFilter<TInputImage, TOutputImage>::DynamicThreadedGenerateData(
+            const OutputImageRegionType &outputRegionForThread) {
+        auto spacing = this->GetInput()->GetSpacing();
         double minspacing = 1e9;
         for(size_t d = 0 ;d < Dimension; ++d) minspacing = std::min(minspacing,spacing[d]);
 
-        auto aofIt = ImageRegionIteratorWithIndex< OutputImageType >(output, output->GetLargestPossibleRegion());
-        auto dIt = ImageRegionIterator< DistanceImageType >(m_DistanceMap, m_DistanceMap->GetLargestPossibleRegion());
-
-        double f = 0;
-        VectorType spokeVector;
-        IndexType currentIndex, spokeIndex, boundaryIndex;
-        OffsetType spokeOffset;
-        for (aofIt.GoToBegin(), dIt.GoToBegin(); !aofIt.IsAtEnd(); ++aofIt,++dIt) {
-            f = 0.0;
-            currentIndex = aofIt.GetIndex();
-            if (dIt.Get() < -1.5*minspacing) {
-                for (auto point: this->m_Points) {
-                    //get spoke vector.
-                    for (size_t d = 0; d < TInputImage::ImageDimension; ++d) {
-                        spokeIndex[d] = std::floor((static_cast<double>(currentIndex[d]) + point[d] + 0.5));
-                    }
-                    spokeOffset = m_FieldAccessor.GetPixel(spokeIndex, m_ClosestPointTransform);
-                    for (size_t d = 0; d < TInputImage::ImageDimension; ++d) {
-                        boundaryIndex[d] = currentIndex[d] + spokeOffset[d];
-                        spokeVector[d] = boundaryIndex[d] - (static_cast<double>(currentIndex[d]) + point[d] + 0.5);
-                    }
-                    spokeVector.Normalize();
-                    //compute dot product of normalized vectors
-                    f -= (spokeVector * point);
-                }
-            }
-            if (m_InwardFlux) f *= -1;
-            aofIt.Set(f);
-        }
+        // flux is only evaluated deeper than 1.5 voxels inside the object.
+        double scale = static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples();
+        if (m_InwardFlux) scale *= -1;
+        m_Kernel.EvaluateRegion(m_ClosestPointTransform.GetPointer(), m_DistanceMap.GetPointer(),
+                                static_cast<typename DistanceImageType::PixelType>(-1.5 * minspacing),
+                                m_FieldAccessor, scale, NumericTraits<OutputPixelType>::ZeroValue(),
+                                this->GetOutput(), outputRegionForThread);
     }
 
 
@@ -160,6 +147,14 @@ namespace itk {
     AverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::PrintSelf(std::ostream &os, Indent indent) const {
         Superclass::PrintSelf(os, indent);
         os << indent << "AverageOutwardFluxImageFilter." << std::endl;
+        os << indent << "NumberOfSamples: " << m_NumberOfSamples << std::endl;
+        os << indent << "ShellRadii:";
+        for (double radius: m_ShellRadii) os << " " << radius;
+        os << std::endl;
+        os << indent << "AdaptiveThresholds:";
+        for (double threshold: m_AdaptiveThresholds) os << " " << threshold;
+        os << std::endl;
+        os << indent << "AdaptiveConfidence: " << m_AdaptiveConfidence << std::endl;
     }
 
 }
@@ -0,0 +1,138 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+#ifndef SKELTOOLS_itkAverageOutwardFluxKernel_h
+#define SKELTOOLS_itkAverageOutwardFluxKernel_h
+
+#include <vector>
+#include <type_traits>
+
+#include <itkVector.h>
+#include <itkOffset.h>
+#include <itkIndex.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageScanlineIterator.h>
+#include <itkNeighborhoodAlgorithm.h>
+
+namespace itk {
+
+/// \brief Per sample tables of the average outward flux stencil.
+/// A sphere sample p is read from the voxel offset round(p) of the current voxel and
+/// compared against the spoke shifted by p + 0.5. Both only depend on the sample, so they
+/// are computed once; for voxels whose stencil lies inside the buffer the spoke is a
+/// strided load from the center pixel.
+/// Spoke fields of floats can also be evaluated a scanline at a time, in float precision with
+/// the voxel loop innermost so the compiler vectorises it for the target instruction set.
+    template<unsigned VDimension>
+    class AverageOutwardFluxKernel {
+    public:
+        using Self = AverageOutwardFluxKernel;
+        static constexpr unsigned Dimension = VDimension;
+        using NormalType = Vector<double, VDimension>;
+        using OffsetType = Offset<VDimension>;
+        using IndexType = Index<VDimension>;
+
+        /// Sphere sample directions on shells of the given radii (voxels), the flux is the negated
+        /// sum over all of them. A sample p of radius r is read at offset round(r p) and shifted by
+        /// r p + 0.5 + round(p) - round(r p), which is the single shell stencil above for r = 1.
+        void SetSamples(const std::vector<NormalType> &samples, const std::vector<double> &radii = {1.0});
+
+        /// Linear strides of the sample offsets in the buffer of image.
+        template<typename TImage>
+        void ComputeStrides(const TImage *image);
+
+        SizeValueType GetNumberOfSamples() const { return m_Normals.size(); }
+
+        /// Largest |offset| of any sample, the stencil radius.
+        SizeValueType GetRadius() const { return m_Radius; }
+
+        /// Adaptive evaluation, off for empty thresholds. Samples are visited in a low discrepancy
+        /// (golden ratio stride) order and a voxel stops once scale times its flux is decided against
+        /// every threshold: no threshold lies in the intersection of the hard bound (each remaining
+        /// sample contributes at most 1 in magnitude) and the interval of confidence standard errors
+        /// around the estimate from the samples taken. A stopped voxel gets that estimate, voxels
+        /// near a threshold take all samples. Scanline runs are not used in adaptive mode.
+        void SetAdaptive(const std::vector<double> &thresholds, double scale, double confidence);
+        bool IsAdaptive() const { return !m_AdaptiveThresholds.empty(); }
+
+        /// Samples taken before an adaptive voxel may stop.
+        static constexpr SizeValueType AdaptiveMinimumSamples = 12;
+
+        /// Flux at a voxel whose whole stencil lies inside the buffer. center points to its
+        /// spoke, strides must have been computed for that buffer.
+        template<typename TPixel>
+        double EvaluateInterior(const TPixel *center) const;
+
+        /// Flux of length consecutive voxels of a scanline whose stencils lie inside the buffer.
+        /// first points to the VDimension float components of the first voxel's spoke.
+        void EvaluateInteriorRun(const float *first, SizeValueType length, float *flux) const;
+
+        /// Flux at index reading spokes through the boundary condition accessor.
+        template<typename TImage, typename TAccessor>
+        double EvaluateBoundary(const TImage *image, const IndexType &index, const TAccessor &accessor) const;
+
+        /// Flux at index with sample voxels clamped to the buffer of image (zero flux Neumann) and
+        /// spokes read as zero at sample voxels where gate(sample index) is false.
+        template<typename TImage, typename TGate>
+        double EvaluateClamped(const TImage *image, const IndexType &index, const TGate &gate) const;
+
+        /// Region loop shared by the AOF filters. Sets the voxels of region in output to scale times
+        /// the flux of spokes, or to outsideValue where distance (if given) is not below threshold.
+        /// Stencils inside the spoke buffer use strided loads (scanline runs for float spokes),
+        /// the image border reads through accessor. Strides must have been computed for spokes.
+        template<typename TSpokeImage, typename TDistanceImage, typename TAccessor, typename TOutputImage>
+        void EvaluateRegion(const TSpokeImage *spokes, const TDistanceImage *distance,
+                            typename TDistanceImage::PixelType threshold, const TAccessor &accessor,
+                            double scale, typename TOutputImage::PixelType outsideValue,
+                            TOutputImage *output, const typename TOutputImage::RegionType &region) const;
+
+    private:
+
+        template<typename TPixel>
+        double SampleFlux(SizeValueType sample, const TPixel &spoke) const;
+
+        /// Negated sum of the sample fluxes, read(k) returns the spoke of sample k.
+        /// Adaptive when thresholds are set.
+        template<typename TRead>
+        double EvaluateSamples(const TRead &read) const;
+
+        template<typename TRead>
+        double EvaluateAdaptive(const TRead &read) const;
+
+        std::vector<NormalType> m_Normals;
+        std::vector<NormalType> m_Shifts;
+        std::vector<OffsetType> m_Offsets;
+        std::vector<OffsetValueType> m_Strides;
+        SizeValueType m_Radius = 0;
+
+        // adaptive mode: sample visiting order, thresholds on the unscaled flux.
+        std::vector<SizeValueType> m_AdaptiveOrder;
+        std::vector<double> m_AdaptiveThresholds;
+        double m_AdaptiveConfidence = 3.0;
+
+        // float struct of arrays copies of the sample tables, one array per component.
+        std::vector<float> m_FloatShifts[VDimension];
+        std::vector<float> m_FloatNormals[VDimension];
+    };
+} // end namespace itk
+
+#include "itkAverageOutwardFluxKernel.hxx"
+
+#endif //SKELTOOLS_itkAverageOutwardFluxKernel_h
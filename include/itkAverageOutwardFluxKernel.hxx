@@ -0,0 +1,290 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+#ifndef SKELTOOLS_itkAverageOutwardFluxKernel_hxx
+#define SKELTOOLS_itkAverageOutwardFluxKernel_hxx
+
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+
+#include "itkAverageOutwardFluxKernel.h"
+
+namespace itk {
+    template<unsigned VDimension>
+    void
+    AverageOutwardFluxKernel<VDimension>::SetSamples(const std::vector<NormalType> &samples,
+                                                    const std::vector<double> &radii) {
+        const SizeValueType count = samples.size() * radii.size();
+        m_Normals.resize(count);
+        m_Shifts.resize(count);
+        m_Offsets.resize(count);
+        m_Strides.assign(count, 0);
+        m_Radius = 0;
+        SizeValueType k = 0;
+        for (const double radius: radii) {
+            for (const auto &sample: samples) {
+                m_Normals[k] = sample;
+                for (unsigned d = 0; d < VDimension; ++d) {
+                    const double point = radius * sample[d];
+                    m_Offsets[k][d] = static_cast<OffsetValueType>(std::floor(point + 0.5));
+                    m_Shifts[k][d] = point + 0.5 + std::floor(sample[d] + 0.5) - m_Offsets[k][d];
+                    m_Radius = std::max<SizeValueType>(m_Radius, std::abs(m_Offsets[k][d]));
+                }
+                ++k;
+            }
+        }
+        // golden ratio stride through the samples, coprime with their count so every sample
+        // is visited once; any prefix is spread over the sphere (and the shells).
+        SizeValueType stride = std::max<SizeValueType>(1, static_cast<SizeValueType>(std::lround(0.381966 * count)));
+        while (std::gcd(stride, count) > 1) ++stride;
+        m_AdaptiveOrder.resize(count);
+        for (k = 0; k < count; ++k) m_AdaptiveOrder[k] = (k * stride) % count;
+
+        for (unsigned d = 0; d < VDimension; ++d) {
+            m_FloatShifts[d].resize(count);
+            m_FloatNormals[d].resize(count);
+            for (k = 0; k < count; ++k) {
+                m_FloatShifts[d][k] = static_cast<float>(m_Shifts[k][d]);
+                m_FloatNormals[d][k] = static_cast<float>(m_Normals[k][d]);
+            }
+        }
+    }
+
+    template<unsigned VDimension>
+    void
+    AverageOutwardFluxKernel<VDimension>::SetAdaptive(const std::vector<double> &thresholds, double scale,
+                                                     double confidence) {
+        m_AdaptiveThresholds.clear();
+        for (const double threshold: thresholds) m_AdaptiveThresholds.push_back(threshold / scale);
+        m_AdaptiveConfidence = confidence;
+    }
+
+    template<unsigned VDimension>
+    template<typename TImage>
+    void
+    AverageOutwardFluxKernel<VDimension>::ComputeStrides(const TImage *image) {
+        const OffsetValueType *offsetTable = image->GetOffsetTable();
+        for (size_t k = 0; k < m_Offsets.size(); ++k) {
+            m_Strides[k] = 0;
+            for (unsigned d = 0; d < VDimension; ++d) {
+                m_Strides[k] += m_Offsets[k][d] * offsetTable[d];
+            }
+        }
+    }
+
+    template<unsigned VDimension>
+    template<typename TPixel>
+    inline double
+    AverageOutwardFluxKernel<VDimension>::SampleFlux(SizeValueType sample, const TPixel &spoke) const {
+        // spoke relative to the sub-voxel sample point, normalized, dotted with the sample direction.
+        const NormalType &shift = m_Shifts[sample];
+        const NormalType &normal = m_Normals[sample];
+        double norm = 0, dot = 0;
+        for (unsigned d = 0; d < VDimension; ++d) {
+            const double v = static_cast<double>(spoke[d]) - shift[d];
+            norm += v * v;
+            dot += v * normal[d];
+        }
+        return norm > 0 ? dot / std::sqrt(norm) : 0.0;
+    }
+
+    template<unsigned VDimension>
+    template<typename TRead>
+    inline double
+    AverageOutwardFluxKernel<VDimension>::EvaluateSamples(const TRead &read) const {
+        if (!m_AdaptiveThresholds.empty()) return this->EvaluateAdaptive(read);
+        double f = 0;
+        for (SizeValueType k = 0; k < m_Offsets.size(); ++k) {
+            f -= this->SampleFlux(k, read(k));
+        }
+        return f;
+    }
+
+    template<unsigned VDimension>
+    template<typename TRead>
+    double
+    AverageOutwardFluxKernel<VDimension>::EvaluateAdaptive(const TRead &read) const {
+        const SizeValueType count = m_AdaptiveOrder.size();
+        double f = 0, mean = 0, m2 = 0;
+        for (SizeValueType taken = 1; taken <= count; ++taken) {
+            const SizeValueType k = m_AdaptiveOrder[taken - 1];
+            const double x = -this->SampleFlux(k, read(k));
+            f += x;
+            // running mean and sum of squared deviations (Welford).
+            const double delta = x - mean;
+            mean += delta / taken;
+            m2 += delta * (x - mean);
+            if (taken < AdaptiveMinimumSamples || taken == count) continue;
+
+            const double remaining = static_cast<double>(count - taken);
+            const double hardLow = f - remaining, hardHigh = f + remaining;
+            // standard error of the total, with the finite population correction.
+            const double estimate = mean * count;
+            const double error = m_AdaptiveConfidence * count * std::sqrt(m2 / (taken - 1) / taken) *
+                                 std::sqrt(remaining / (count - 1));
+            const double low = std::max(hardLow, estimate - error), high = std::min(hardHigh, estimate + error);
+            bool decided = true;
+            for (const double threshold: m_AdaptiveThresholds) {
+                if (low <= threshold && threshold <= high) {
+                    decided = false;
+                    break;
+                }
+            }
+            if (decided) return std::min(std::max(estimate, hardLow), hardHigh);
+        }
+        return f;
+    }
+
+    template<unsigned VDimension>
+    template<typename TPixel>
+    double
+    AverageOutwardFluxKernel<VDimension>::EvaluateInterior(const TPixel *center) const {
+        return this->EvaluateSamples([this, center](SizeValueType k) -> const TPixel & {
+            return center[m_Strides[k]];
+        });
+    }
+
+    template<unsigned VDimension>
+    void
+    AverageOutwardFluxKernel<VDimension>::EvaluateInteriorRun(const float *first, SizeValueType length,
+                                                             float *flux) const {
+        // samples outer, voxels inner: every sample reads a contiguous run of spokes, so the
+        // voxel loop vectorises (with -ffast-math the reciprocal square root is rsqrt + Newton).
+        std::fill_n(flux, length, 0.0f);
+        for (SizeValueType k = 0; k < m_Strides.size(); ++k) {
+            const float *spoke = first + m_Strides[k] * static_cast<OffsetValueType>(VDimension);
+            float shift[VDimension], normal[VDimension];
+            for (unsigned d = 0; d < VDimension; ++d) {
+                shift[d] = m_FloatShifts[d][k];
+                normal[d] = m_FloatNormals[d][k];
+            }
+            for (SizeValueType i = 0; i < length; ++i) {
+                float norm = 0.0f, dot = 0.0f;
+                for (unsigned d = 0; d < VDimension; ++d) {
+                    const float v = spoke[i * VDimension + d] - shift[d];
+                    norm += v * v;
+                    dot += v * normal[d];
+                }
+                flux[i] -= norm > 0.0f ? dot * (1.0f / std::sqrt(norm)) : 0.0f;
+            }
+        }
+    }
+
+    template<unsigned VDimension>
+    template<typename TImage, typename TAccessor>
+    double
+    AverageOutwardFluxKernel<VDimension>::EvaluateBoundary(const TImage *image, const IndexType &index,
+                                                          const TAccessor &accessor) const {
+        return this->EvaluateSamples([this, image, &index, &accessor](SizeValueType k) {
+            return accessor.GetPixel(index + m_Offsets[k], image);
+        });
+    }
+
+    template<unsigned VDimension>
+    template<typename TImage, typename TGate>
+    double
+    AverageOutwardFluxKernel<VDimension>::EvaluateClamped(const TImage *image, const IndexType &index,
+                                                         const TGate &gate) const {
+        const auto &buffer = image->GetBufferedRegion();
+        return this->EvaluateSamples([this, image, &index, &gate, &buffer](SizeValueType k) {
+            IndexType sample = index + m_Offsets[k];
+            for (unsigned d = 0; d < VDimension; ++d) {
+                const IndexValueType first = buffer.GetIndex(d);
+                const IndexValueType last = first + static_cast<IndexValueType>(buffer.GetSize(d)) - 1;
+                sample[d] = std::min(std::max(sample[d], first), last);
+            }
+            Vector<float, VDimension> spoke;
+            spoke.Fill(0.0f);
+            if (gate(sample)) {
+                const auto &pixel = image->GetPixel(sample);
+                for (unsigned d = 0; d < VDimension; ++d) spoke[d] = static_cast<float>(pixel[d]);
+            }
+            return spoke;
+        });
+    }
+
+    template<unsigned VDimension>
+    template<typename TSpokeImage, typename TDistanceImage, typename TAccessor, typename TOutputImage>
+    void
+    AverageOutwardFluxKernel<VDimension>::EvaluateRegion(const TSpokeImage *spokes, const TDistanceImage *distance,
+                                                        typename TDistanceImage::PixelType threshold,
+                                                        const TAccessor &accessor,
+                                                        double scale, typename TOutputImage::PixelType outsideValue,
+                                                        TOutputImage *output,
+                                                        const typename TOutputImage::RegionType &region) const {
+        using DistancePixelType = typename TDistanceImage::PixelType;
+        constexpr bool floatSpokes = std::is_same_v<typename TSpokeImage::PixelType, Vector<float, VDimension>>;
+
+        // the first face has the whole sample stencil inside the input buffer,
+        // the others go through the boundary condition.
+        using FaceCalculatorType = NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TSpokeImage>;
+        typename TSpokeImage::SizeType radius;
+        radius.Fill(m_Radius);
+        FaceCalculatorType faceCalculator;
+        auto faceList = faceCalculator(spokes, region, radius);
+
+        bool interior = true;
+        for (const auto &face: faceList) {
+            if (interior && floatSpokes && !this->IsAdaptive()) {
+                ImageScanlineConstIterator<TSpokeImage> spokeIt(spokes, face);
+                ImageScanlineIterator<TOutputImage> aofIt(output, face);
+                const SizeValueType length = face.GetSize(0);
+                std::vector<float> flux(length);
+                while (!aofIt.IsAtEnd()) {
+                    const auto *line = reinterpret_cast<const float *>(&spokeIt.Value());
+                    const DistancePixelType *depth = distance
+                            ? distance->GetBufferPointer() + distance->ComputeOffset(aofIt.GetIndex())
+                            : nullptr;
+                    // evaluate the runs of voxels below the distance threshold.
+                    SizeValueType begin = 0;
+                    while (begin < length) {
+                        if (depth && !(depth[begin] < threshold)) {
+                            ++begin;
+                            continue;
+                        }
+                        SizeValueType end = begin + 1;
+                        while (end < length && (!depth || depth[end] < threshold)) ++end;
+                        this->EvaluateInteriorRun(line + begin * VDimension, end - begin, flux.data() + begin);
+                        begin = end;
+                    }
+                    for (SizeValueType i = 0; i < length; ++i, ++aofIt) {
+                        aofIt.Set(depth && !(depth[i] < threshold) ? outsideValue : scale * flux[i]);
+                    }
+                    aofIt.NextLine();
+                    spokeIt.NextLine();
+                }
+            } else {
+                ImageRegionConstIterator<TSpokeImage> spokeIt(spokes, face);
+                ImageRegionIteratorWithIndex<TOutputImage> aofIt(output, face);
+                for (spokeIt.GoToBegin(), aofIt.GoToBegin(); !aofIt.IsAtEnd(); ++spokeIt, ++aofIt) {
+                    if (distance && !(distance->GetPixel(aofIt.GetIndex()) < threshold)) {
+                        aofIt.Set(outsideValue);
+                    } else if (interior) {
+                        aofIt.Set(scale * this->EvaluateInterior(&spokeIt.Value()));
+                    } else {
+                        aofIt.Set(scale * this->EvaluateBoundary(spokes, aofIt.GetIndex(), accessor));
+                    }
+                }
+            }
+            interior = false;
+        }
+    }
+}
+#endif //SKELTOOLS_itkAverageOutwardFluxKernel_hxx
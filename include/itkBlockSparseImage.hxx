@@ -0,0 +1,275 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+#ifndef SKELTOOLS_itkBlockSparseImage_hxx
+#define SKELTOOLS_itkBlockSparseImage_hxx
+
+#include <algorithm>
+
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include "itkBlockSparseImage.h"
+
+namespace itk {
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::BlockSparseImage() {
+        m_BackgroundValue = NumericTraits<PixelType>::ZeroValue();
+        m_Spacing.Fill(1.0);
+        m_Origin.Fill(0.0);
+        m_Direction.SetIdentity();
+        m_GridSize.Fill(0);
+        m_NumberOfActiveBlocks = 0;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::SetRegions(const RegionType &region) {
+        m_Region = region;
+        SizeValueType numberOfBlocks = 1;
+        for (unsigned d = 0; d < VDimension; ++d) {
+            m_GridSize[d] = (region.GetSize(d) + VBlockSize - 1) / VBlockSize;
+            numberOfBlocks *= m_GridSize[d];
+        }
+        m_Blocks.clear();
+        m_Blocks.resize(numberOfBlocks);
+        m_NumberOfActiveBlocks = 0;
+        this->Modified();
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::CopyInformation(const ImageBase<VDimension> *image) {
+        this->SetRegions(image->GetLargestPossibleRegion());
+        m_Spacing = image->GetSpacing();
+        m_Origin = image->GetOrigin();
+        m_Direction = image->GetDirection();
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    SizeValueType
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ComputeBlockNumber(const IndexType &blockIndex) const {
+        SizeValueType block = 0;
+        for (int d = VDimension - 1; d >= 0; --d) {
+            block = block * m_GridSize[d] + blockIndex[d];
+        }
+        return block;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ComputeBlockLocation(const IndexType &index,
+                                                                         SizeValueType &block,
+                                                                         SizeValueType &offset) const {
+        block = 0;
+        offset = 0;
+        for (int d = VDimension - 1; d >= 0; --d) {
+            const SizeValueType local = index[d] - m_Region.GetIndex(d);
+            block = block * m_GridSize[d] + local / VBlockSize;
+            offset = offset * VBlockSize + local % VBlockSize;
+        }
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    typename BlockSparseImage<TPixel, VDimension, VBlockSize>::RegionType
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ComputeBlockRegion(SizeValueType block) const {
+        IndexType start;
+        SizeType size;
+        for (unsigned d = 0; d < VDimension; ++d) {
+            start[d] = m_Region.GetIndex(d) + static_cast<IndexValueType>((block % m_GridSize[d]) * VBlockSize);
+            block /= m_GridSize[d];
+            size[d] = VBlockSize;
+        }
+        RegionType region(start, size);
+        region.Crop(m_Region);
+        return region;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::AllocateBlock(SizeValueType block) {
+        if (m_Blocks[block]) return;
+        m_Blocks[block] = BlockPointerType(new TPixel[BlockVolume()]);
+        std::fill_n(m_Blocks[block].get(), BlockVolume(), m_BackgroundValue);
+        ++m_NumberOfActiveBlocks;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    typename BlockSparseImage<TPixel, VDimension, VBlockSize>::PixelType
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::GetPixel(const IndexType &index) const {
+        if (!m_Region.IsInside(index)) return m_BackgroundValue;
+        SizeValueType block, offset;
+        this->ComputeBlockLocation(index, block, offset);
+        const auto &data = m_Blocks[block];
+        return data ? data[offset] : m_BackgroundValue;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::SetPixel(const IndexType &index, const PixelType &value) {
+        if (!m_Region.IsInside(index)) return;
+        SizeValueType block, offset;
+        this->ComputeBlockLocation(index, block, offset);
+        if (!m_Blocks[block]) {
+            if (value == m_BackgroundValue) return;
+            this->AllocateBlock(block);
+        }
+        m_Blocks[block][offset] = value;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    bool
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::IsBlockActive(const IndexType &index) const {
+        if (!m_Region.IsInside(index)) return false;
+        SizeValueType block, offset;
+        this->ComputeBlockLocation(index, block, offset);
+        return static_cast<bool>(m_Blocks[block]);
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ActivateBlock(const IndexType &index) {
+        if (!m_Region.IsInside(index)) return;
+        SizeValueType block, offset;
+        this->ComputeBlockLocation(index, block, offset);
+        this->AllocateBlock(block);
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    template<typename TImage>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ActivateFromImage(const TImage *image,
+                                                                      unsigned dilation) {
+        if (m_Blocks.empty()) this->CopyInformation(image);
+
+        std::vector<bool> touched(m_Blocks.size(), false);
+        ImageRegionConstIteratorWithIndex<TImage> it(image, m_Region);
+        SizeValueType block, offset;
+        for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+            if (it.Get() != NumericTraits<typename TImage::PixelType>::ZeroValue()) {
+                this->ComputeBlockLocation(it.GetIndex(), block, offset);
+                touched[block] = true;
+            }
+        }
+
+        // dilate in block space, one block ring at a time.
+        RegionType gridRegion;
+        gridRegion.SetSize(m_GridSize);
+        for (unsigned ring = 0; ring < dilation; ++ring) {
+            std::vector<bool> grown(touched);
+            for (SizeValueType b = 0; b < touched.size(); ++b) {
+                if (!touched[b]) continue;
+                IndexType center;
+                SizeValueType rest = b;
+                for (unsigned d = 0; d < VDimension; ++d) {
+                    center[d] = rest % m_GridSize[d];
+                    rest /= m_GridSize[d];
+                }
+                RegionType neighbours(center, SizeType::Filled(1));
+                neighbours.PadByRadius(1);
+                neighbours.Crop(gridRegion);
+                // iterate block indices of the neighbourhood
+                for (SizeValueType n = 0; n < neighbours.GetNumberOfPixels(); ++n) {
+                    IndexType blockIndex;
+                    SizeValueType r = n;
+                    for (unsigned d = 0; d < VDimension; ++d) {
+                        blockIndex[d] = neighbours.GetIndex(d) + r % neighbours.GetSize(d);
+                        r /= neighbours.GetSize(d);
+                    }
+                    grown[this->ComputeBlockNumber(blockIndex)] = true;
+                }
+            }
+            touched.swap(grown);
+        }
+
+        for (SizeValueType b = 0; b < touched.size(); ++b) {
+            if (touched[b]) this->AllocateBlock(b);
+        }
+        itkDebugMacro("Activated " << m_NumberOfActiveBlocks << " of " << m_Blocks.size() << " blocks");
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::FillFromImage(const DenseImageType *image) {
+        this->ActivateFromImage(image, 0);
+        for (const auto &blockRegion: this->GetActiveBlockRegions()) {
+            ImageRegionConstIteratorWithIndex<DenseImageType> it(image, blockRegion);
+            for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+                if (it.Get() != NumericTraits<PixelType>::ZeroValue()) this->SetPixel(it.GetIndex(), it.Get());
+            }
+        }
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::FillActive(const PixelType &value) {
+        for (auto &data: m_Blocks) {
+            if (data) std::fill_n(data.get(), BlockVolume(), value);
+        }
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    typename BlockSparseImage<TPixel, VDimension, VBlockSize>::DenseImagePointerType
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::ToImage() const {
+        DenseImagePointerType image = DenseImageType::New();
+        image->SetRegions(m_Region);
+        image->SetSpacing(m_Spacing);
+        image->SetOrigin(m_Origin);
+        image->SetDirection(m_Direction);
+        image->Allocate();
+        image->FillBuffer(m_BackgroundValue);
+        for (const auto &blockRegion: this->GetActiveBlockRegions()) {
+            ImageRegionIteratorWithIndex<DenseImageType> it(image, blockRegion);
+            for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+                it.Set(this->GetPixel(it.GetIndex()));
+            }
+        }
+        return image;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    std::vector<typename BlockSparseImage<TPixel, VDimension, VBlockSize>::RegionType>
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::GetActiveBlockRegions() const {
+        std::vector<RegionType> regions;
+        regions.reserve(m_NumberOfActiveBlocks);
+        for (SizeValueType b = 0; b < m_Blocks.size(); ++b) {
+            if (m_Blocks[b]) regions.push_back(this->ComputeBlockRegion(b));
+        }
+        return regions;
+    }
+
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    SizeValueType
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::GetAllocatedBytes() const {
+        return m_NumberOfActiveBlocks * BlockVolume() * sizeof(TPixel)
+               + m_Blocks.size() * sizeof(BlockPointerType);
+    }
+
+/**
+*  Print Self
+*/
+    template<typename TPixel, unsigned VDimension, unsigned VBlockSize>
+    void
+    BlockSparseImage<TPixel, VDimension, VBlockSize>::PrintSelf(std::ostream &os, Indent indent) const {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "BlockSparseImage: " << m_NumberOfActiveBlocks << " of " << m_Blocks.size()
+           << " blocks of size " << VBlockSize << " active." << std::endl;
+    }
+}
+#endif //SKELTOOLS_itkBlockSparseImage_hxx
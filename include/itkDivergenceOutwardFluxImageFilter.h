@@ -0,0 +1,105 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+#ifndef SKELTOOLS_itkDivergenceOutwardFluxImageFilter_h
+#define SKELTOOLS_itkDivergenceOutwardFluxImageFilter_h
+
+#include <itkImageToImageFilter.h>
+#include <itkConstNeighborhoodIterator.h>
+#include <itkNeighborhood.h>
+#include <itkImageRegionIterator.h>
+#include <itkNeighborhoodAlgorithm.h>
+#include <itkZeroFluxNeumannBoundaryCondition.h>
+
+namespace itk {
+
+/// \brief Fast approximation of the average outward flux from a signed distance map
+/// (inside negative): the divergence of the normalized distance gradient, the limit of the
+/// sphere flux for vanishing radius.
+///
+/// The normalized gradient is taken at the 2 * Dimension half voxel points around a voxel
+/// (normal derivative by a one voxel difference, tangential ones averaged central differences),
+/// in index space like the unit voxel spheres of the AOF filters. That is 19 distance loads in
+/// 3D (9 in 2D) per voxel, instead of 60 spoke gathers and normalizations.
+///
+/// Comparison with SpokeFieldToAverageOutwardFluxImageFilter (60 samples, radius 1):
+/// - Values are scaled so that an ideal medial sheet (spokes flipping across one voxel) gives the
+///   sphere flux, -30 in 3D and -120/pi in 2D, so curve/surface thresholds carry over.
+/// - Where spokes flip in two directions (medial curves in 3D) the sphere gives about -47 and
+///   the divergence saturates at the clamp -60, curve points are found more readily.
+/// - In smooth regions both are proportional to the level set curvature, the divergence values are
+///   3/4 (3D) and 2/pi (2D) of the sphere flux there, far from any threshold.
+/// - The distance gradient is read one voxel around like the radius 1 sphere, so both localise
+///   the medial set equally. The sphere flux sees the exact closest point directions, the
+///   divergence the voxelised distance map; on objects thinner than about 3 voxels and on
+///   noisy boundaries it is less reliable, it is meant for screening runs.
+    template<typename TInputImage, typename TOutputImage = TInputImage>
+    class ITK_TEMPLATE_EXPORT DivergenceOutwardFluxImageFilter :
+            public ImageToImageFilter<TInputImage, TOutputImage> {
+    public:
+        /** Standard class typedefs. */
+        using Self = DivergenceOutwardFluxImageFilter;
+        using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+        using Pointer = SmartPointer<Self>;
+        using ConstPointer = SmartPointer<const Self>;
+
+        static constexpr unsigned Dimension = TInputImage::ImageDimension;
+
+        /** Method for creation through the object factory */
+        itkNewMacro(Self);
+
+        /** Run-time type information (and related methods). */
+        itkTypeMacro(DivergenceOutwardFluxImageFilter, ImageToImageFilter);
+
+        using InputPixelType = typename TInputImage::PixelType;
+        using OutputPixelType = typename TOutputImage::PixelType;
+        using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+        using BoundaryConditionType = ZeroFluxNeumannBoundaryCondition<TInputImage>;
+        using NeighborhoodIteratorType = ConstNeighborhoodIterator<TInputImage, BoundaryConditionType>;
+
+        /// Number of sphere samples the flux values are normalized to.
+        static constexpr unsigned ReferenceNumberOfSamples = 60;
+
+        /// The flux is only evaluated where the distance is below DistanceThreshold (default 0,
+        /// the object interior), other voxels are set to OutsideValue (default 0).
+        itkSetMacro(DistanceThreshold, double);
+        itkGetConstMacro(DistanceThreshold, double);
+        itkSetMacro(OutsideValue, OutputPixelType);
+        itkGetConstMacro(OutsideValue, OutputPixelType);
+
+    protected:
+        DivergenceOutwardFluxImageFilter();
+        ~DivergenceOutwardFluxImageFilter() override = default;
+
+        void GenerateInputRequestedRegion() override;
+
+        void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) override;
+
+        void PrintSelf(std::ostream &os, Indent indent) const override;
+
+    private:
+        double m_DistanceThreshold;
+        OutputPixelType m_OutsideValue;
+    };
+} // end namespace itk
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDivergenceOutwardFluxImageFilter.hxx"
+#endif
+
+#endif //SKELTOOLS_itkDivergenceOutwardFluxImageFilter_h
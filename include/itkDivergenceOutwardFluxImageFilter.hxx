@@ -0,0 +1,133 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+#ifndef SKELTOOLS_itkDivergenceOutwardFluxImageFilter_hxx
+#define SKELTOOLS_itkDivergenceOutwardFluxImageFilter_hxx
+
+#include <algorithm>
+#include <cmath>
+
+#include "itkDivergenceOutwardFluxImageFilter.h"
+
+namespace itk {
+    template<typename TInputImage, typename TOutputImage>
+    DivergenceOutwardFluxImageFilter<TInputImage, TOutputImage>::DivergenceOutwardFluxImageFilter() {
+        this->DynamicMultiThreadingOn();
+        m_DistanceThreshold = 0.0;
+        m_OutsideValue = NumericTraits<OutputPixelType>::ZeroValue();
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    DivergenceOutwardFluxImageFilter<TInputImage, TOutputImage>::GenerateInputRequestedRegion() {
+        Superclass::GenerateInputRequestedRegion();
+        auto input = const_cast<TInputImage *>(this->GetInput());
+        if (!input) return;
+        auto requested = input->GetRequestedRegion();
+        requested.PadByRadius(1);
+        requested.Crop(input->GetLargestPossibleRegion());
+        input->SetRequestedRegion(requested);
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    DivergenceOutwardFluxImageFilter<TInputImage, TOutputImage>::DynamicThreadedGenerateData(
+            const OutputImageRegionType &outputRegionForThread) {
+        const TInputImage *input = this->GetInput();
+        TOutputImage *output = this->GetOutput();
+        const double pi = std::acos(-1.0);
+        // flux of an ideal medial sheet (divergence 2) equals the 60 sample sphere flux.
+        const double scale = Dimension == 2 ? ReferenceNumberOfSamples / pi
+                                            : ReferenceNumberOfSamples / 4.0;
+        const double limit = ReferenceNumberOfSamples;
+
+        typename TInputImage::SizeType radius;
+        radius.Fill(1);
+
+        // neighbourhood positions of x + side e_d (normal) and x + a e_d + b e_j (tangential),
+        // index 0 of side, a and b is -1, index 1 is +1.
+        Neighborhood<InputPixelType, Dimension> stencil;
+        stencil.SetRadius(radius);
+        auto position = [&stencil](unsigned d, int a, unsigned j, int b) {
+            typename TInputImage::OffsetType offset{};
+            offset[d] += a;
+            offset[j] += b;
+            return stencil.GetNeighborhoodIndex(offset);
+        };
+        SizeValueType normalPosition[Dimension][2];
+        SizeValueType tangentPosition[Dimension][2][Dimension][2][2];
+        for (unsigned d = 0; d < Dimension; ++d) {
+            for (int s = 0; s < 2; ++s) {
+                const int side = 2 * s - 1;
+                normalPosition[d][s] = position(d, side, d, 0);
+                for (unsigned j = 0; j < Dimension; ++j) {
+                    if (j == d) continue;
+                    for (int b = 0; b < 2; ++b) {
+                        tangentPosition[d][s][j][b][0] = position(d, 0, j, 2 * b - 1);
+                        tangentPosition[d][s][j][b][1] = position(d, side, j, 2 * b - 1);
+                    }
+                }
+            }
+        }
+
+        NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage> faceCalculator;
+        auto faceList = faceCalculator(input, outputRegionForThread, radius);
+        for (const auto &face: faceList) {
+            NeighborhoodIteratorType it(radius, input, face);
+            ImageRegionIterator<TOutputImage> out(output, face);
+            for (it.GoToBegin(), out.GoToBegin(); !it.IsAtEnd(); ++it, ++out) {
+                const double value = it.GetCenterPixel();
+                if (!(value < m_DistanceThreshold)) {
+                    out.Set(m_OutsideValue);
+                    continue;
+                }
+                double divergence = 0;
+                for (unsigned d = 0; d < Dimension; ++d) {
+                    for (int s = 0; s < 2; ++s) {
+                        // normalized gradient at the half voxel point x + side/2 e_d.
+                        const int side = 2 * s - 1;
+                        const double normal = side * (it.GetPixel(normalPosition[d][s]) - value);
+                        double norm = normal * normal;
+                        for (unsigned j = 0; j < Dimension; ++j) {
+                            if (j == d) continue;
+                            const auto &around = tangentPosition[d][s][j];
+                            const double tangent = 0.25 * (it.GetPixel(around[1][0]) - it.GetPixel(around[0][0])
+                                                           + it.GetPixel(around[1][1]) - it.GetPixel(around[0][1]));
+                            norm += tangent * tangent;
+                        }
+                        if (norm > 0) divergence += side * normal / std::sqrt(norm);
+                    }
+                }
+                out.Set(static_cast<OutputPixelType>(std::clamp(-scale * divergence, -limit, limit)));
+            }
+        }
+    }
+
+/**
+*  Print Self
+*/
+    template<typename TInputImage, typename TOutputImage>
+    void
+    DivergenceOutwardFluxImageFilter<TInputImage, TOutputImage>::PrintSelf(std::ostream &os, Indent indent) const {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "DivergenceOutwardFluxImageFilter." << std::endl;
+        os << indent << "DistanceThreshold: " << m_DistanceThreshold << std::endl;
+        os << indent << "OutsideValue: " << m_OutsideValue << std::endl;
+    }
+}
+#endif //SKELTOOLS_itkDivergenceOutwardFluxImageFilter_hxx
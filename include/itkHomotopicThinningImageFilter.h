@@ -110,9 +110,34 @@ namespace itk
         using ChamferThresholdFilterType = itk::BinaryThresholdImageFilter<InputImageType, InternalImageType>;
         using ChamferType = FastChamferDistanceImageFilter<InternalImageType, InternalImageType>;
 
+        using IntegerDistanceType = int;
+        using IntegerDistanceImageType = Image<IntegerDistanceType, 3>;
+
+        /// Order in which object voxels are visited.
+        /// Heap: all object voxels in a heap on float chamfer distances.
+        /// BucketQueue: integer 3-4-5 chamfer distances and a bucket queue, fed from the
+        /// boundary as thinning proceeds instead of holding every object voxel up front.
+        /// Directional: layer by layer, 6 directional subiterations, each split into 8
+        /// subfields (voxel parity). Voxels of a subfield are never 26-adjacent, so their
+        /// simple points are removed in parallel. Distance order is approximated by layers.
+        enum class EngineType : unsigned char { Heap, BucketQueue, Directional };
+
         //void
         //GenerateInputRequestedRegion() override;
 
+        itkSetEnumMacro(Engine, EngineType);
+        itkGetEnumMacro(Engine, EngineType);
+
+        /// Record the iteration (1 based, in the unit of MaxIterations for every engine) in which
+        /// each voxel is removed: infinity for kept voxels, 0 for the background. The result for
+        /// MaxIterations k is then the voxels with a value > k.
+        itkSetMacro(ComputeRemovalDistance, bool);
+        itkGetConstMacro(ComputeRemovalDistance, bool);
+        itkBooleanMacro(ComputeRemovalDistance);
+        typename InternalImageType::Pointer GetRemovalDistanceImage() {
+            return m_RemovalDistance;
+        }
+
         itkSetMacro(MaxIterations, unsigned);
         itkGetConstMacro(MaxIterations, unsigned);
 
@@ -129,8 +154,24 @@ namespace itk
         ~HomotopicThinningImageFilter() = default;
 
         void GenerateData() override;
+        void GenerateDataBucketQueue();
+        void GenerateDataDirectional();
+
+        /// 3-4-5 chamfer distance of the object (input >= LowerThreshold) to the background,
+        /// 3 per voxel step. Object voxels not reached from any background voxel keep max.
+        typename IntegerDistanceImageType::Pointer ComputeIntegerChamferDistance();
+
+        void InitializeRemovalDistance();
+        void RecordRemoval(const IndexType &index, InternalPixelType depth) {
+            if (m_RemovalDistance != nullptr) m_RemovalDistance->SetPixel(index, depth);
+        }
+        /// Kept object voxels get infinity.
+        void FinalizeRemovalDistance();
 
     private:
+        EngineType m_Engine = EngineType::Heap;
+        bool m_ComputeRemovalDistance = false;
+        typename InternalImageType::Pointer m_RemovalDistance;
         unsigned m_MaxIterations = NumericTraits<unsigned>::max();
         InputPixelType m_LowerThreshold = NumericTraits<InputPixelType>::OneValue();
         double m_MinSpacing = 1;
@@ -27,11 +27,17 @@
 #include <iostream>
 #include <ctime>
 #include <itkImageFileWriter.h>
+#include <itkImageRegionIterator.h>
 #include <itkApproximateSignedDistanceMapImageFilter.h>
 #include <itkSignedMaurerDistanceMapImageFilter.h>
 #include <itkDanielssonDistanceMapImageFilter.h>
 #include <string>
 #include <functional>
+#include <limits>
+#include <cmath>
+#include <array>
+#include <mutex>
+#include <itkMultiThreaderBase.h>
 
 namespace itk{
 
@@ -115,6 +121,14 @@ namespace itk{
     template< class InputPixelType, class OutputPixelType>
     void
     HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::GenerateData() {
+        if (m_Engine == EngineType::BucketQueue) {
+            this->GenerateDataBucketQueue();
+            return;
+        }
+        if (m_Engine == EngineType::Directional) {
+            this->GenerateDataDirectional();
+            return;
+        }
         this->AllocateOutputs();
         InputImagePointer input = const_cast<InputImageType *>(this->GetInput(0));
         this->m_Output = this->GetOutput(0);
@@ -139,6 +153,7 @@ namespace itk{
         using DistIteratorType = ImageRegionIteratorWithIndex< InternalImageType >;
         DistIteratorType dIt = DistIteratorType(distanceMap, distanceMap->GetRequestedRegion());
         OutputIteratorType outIt = OutputIteratorType(m_Output, m_Output->GetRequestedRegion());
+        this->InitializeRemovalDistance();
 
         using NodeType = std::pair<itk::Index<3>, float>;
         const auto cmp = [](NodeType const& left, NodeType const& right) { return left.second > right.second; };
@@ -157,22 +172,299 @@ namespace itk{
 			++outIt;
         }
 
+        // a run with MaxIterations k pops a node while the distance popped before it is below
+        // k * MinSpacing, so recording the first such k from that previous distance makes a run
+        // with MaxIterations k remove exactly the voxels recorded at iterations <= k.
         float current_distance = 0;
+        float previous_distance = 0;
         IndexType current_index;
         while(current_distance < maximumDistance && !q.empty()){
             NodeType current_node = q.top();
+            previous_distance = current_distance;
             current_distance = current_node.second;
             current_index = current_node.first;
             q.pop();
             if (isRemovable(current_index)){
                 m_Output->SetPixel(current_index, m_OutsideValue);
+                this->RecordRemoval(current_index,
+                                    static_cast<InternalPixelType>(std::floor(previous_distance / m_MinSpacing) + 1));
                 ++this->m_RemoveCount;
             }
             ++this->m_Count;
         }
+        this->FinalizeRemovalDistance();
+        itkDebugMacro("Removed " + std::to_string(this->m_RemoveCount) + " of " + std::to_string(this->m_Count) + " voxels");
+    }
+
+    template< class InputPixelType, class OutputPixelType>
+    typename HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::IntegerDistanceImageType::Pointer
+    HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::ComputeIntegerChamferDistance() {
+        const InputImageType *input = this->GetInput(0);
+        const auto region = m_Output->GetRequestedRegion();
+        constexpr IntegerDistanceType unreached = NumericTraits<IntegerDistanceType>::max() / 2;
+
+        auto distance = IntegerDistanceImageType::New();
+        distance->CopyInformation(m_Output);
+        distance->SetRegions(region);
+        distance->Allocate();
+
+        ImageRegionConstIterator<InputImageType> inIt(input, region);
+        ImageRegionIterator<IntegerDistanceImageType> dIt(distance, region);
+        for (; !dIt.IsAtEnd(); ++inIt, ++dIt) {
+            dIt.Set(inIt.Get() >= m_LowerThreshold ? unreached : 0);
+        }
+
+        // forward mask: the 13 neighbours before a voxel in raster order, weight 3/4/5 for
+        // face/edge/corner neighbours. The backward pass mirrors it.
+        struct Step { OffsetValueType dx, dy, dz; IntegerDistanceType weight; };
+        std::vector<Step> forward;
+        for (OffsetValueType dz = -1; dz <= 1; ++dz) {
+            for (OffsetValueType dy = -1; dy <= 1; ++dy) {
+                for (OffsetValueType dx = -1; dx <= 1; ++dx) {
+                    if (dz > 0 || (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0)))) continue;
+                    const IntegerDistanceType nonZero = (dx != 0) + (dy != 0) + (dz != 0);
+                    forward.push_back({dx, dy, dz, 2 + nonZero});
+                }
+            }
+        }
+
+        const auto size = region.GetSize();
+        const OffsetValueType nx = size[0], ny = size[1], nz = size[2];
+        IntegerDistanceType *buffer = distance->GetBufferPointer();
+        auto relax = [&](OffsetValueType x, OffsetValueType y, OffsetValueType z, int sign) {
+            IntegerDistanceType &value = buffer[(z * ny + y) * nx + x];
+            if (value == 0) return;
+            for (const Step &step: forward) {
+                const OffsetValueType sx = x + sign * step.dx, sy = y + sign * step.dy, sz = z + sign * step.dz;
+                if (sx < 0 || sy < 0 || sz < 0 || sx >= nx || sy >= ny || sz >= nz) continue;
+                value = std::min(value, buffer[(sz * ny + sy) * nx + sx] + step.weight);
+            }
+        };
+        for (OffsetValueType z = 0; z < nz; ++z)
+            for (OffsetValueType y = 0; y < ny; ++y)
+                for (OffsetValueType x = 0; x < nx; ++x) relax(x, y, z, 1);
+        for (OffsetValueType z = nz - 1; z >= 0; --z)
+            for (OffsetValueType y = ny - 1; y >= 0; --y)
+                for (OffsetValueType x = nx - 1; x >= 0; --x) relax(x, y, z, -1);
+
+        // relaxation from an unreached neighbour may leave values just above unreached.
+        for (dIt.GoToBegin(); !dIt.IsAtEnd(); ++dIt) {
+            if (dIt.Get() > unreached) dIt.Set(unreached);
+        }
+        return distance;
+    }
+
+    template< class InputPixelType, class OutputPixelType>
+    void
+    HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::InitializeRemovalDistance() {
+        m_RemovalDistance = nullptr;
+        if (!m_ComputeRemovalDistance) return;
+        m_RemovalDistance = InternalImageType::New();
+        m_RemovalDistance->CopyInformation(m_Output);
+        m_RemovalDistance->SetRegions(m_Output->GetRequestedRegion());
+        m_RemovalDistance->Allocate();
+        m_RemovalDistance->FillBuffer(NumericTraits<InternalPixelType>::ZeroValue());
+    }
+
+    template< class InputPixelType, class OutputPixelType>
+    void
+    HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::FinalizeRemovalDistance() {
+        if (m_RemovalDistance == nullptr) return;
+        ImageRegionConstIterator<OutputImageType> outIt(m_Output, m_Output->GetRequestedRegion());
+        ImageRegionIterator<InternalImageType> rIt(m_RemovalDistance, m_Output->GetRequestedRegion());
+        for (; !outIt.IsAtEnd(); ++outIt, ++rIt) {
+            if (outIt.Get() != m_OutsideValue) rIt.Set(std::numeric_limits<InternalPixelType>::infinity());
+        }
+    }
+
+    template< class InputPixelType, class OutputPixelType>
+    void
+    HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::GenerateDataBucketQueue() {
+        this->AllocateOutputs();
+        InputImagePointer input = const_cast<InputImageType *>(this->GetInput(0));
+        this->m_Output = this->GetOutput(0);
+        this->m_RemoveCount = 0;
+        this->m_Count = 0;
+        input->SetRequestedRegionToLargestPossibleRegion();
+
+        constexpr IntegerDistanceType unreached = NumericTraits<IntegerDistanceType>::max() / 2;
+        const auto region = m_Output->GetRequestedRegion();
+        auto distance = this->ComputeIntegerChamferDistance();
+        this->InitializeRemovalDistance();
+        IntegerDistanceType *buffer = distance->GetBufferPointer();
+
+        // 3 chamfer units per voxel of depth; the integer chamfer ignores spacing.
+        const double maximumDepth = 3.0 * static_cast<double>(m_MaxIterations);
+
+        std::vector<Offset<3>> neighbours;
+        for (OffsetValueType dz = -1; dz <= 1; ++dz)
+            for (OffsetValueType dy = -1; dy <= 1; ++dy)
+                for (OffsetValueType dx = -1; dx <= 1; ++dx)
+                    if (dx != 0 || dy != 0 || dz != 0) neighbours.push_back({{dx, dy, dz}});
+
+        // queued voxels are marked by negating their distance.
+        std::vector<std::vector<OffsetValueType>> buckets;
+        auto enqueue = [&](OffsetValueType offset, IntegerDistanceType minimumBucket) {
+            const IntegerDistanceType d = buffer[offset];
+            buffer[offset] = -d;
+            const auto bucket = static_cast<std::size_t>(std::max(d, minimumBucket));
+            if (bucket >= buckets.size()) buckets.resize(bucket + 1);
+            buckets[bucket].push_back(offset);
+        };
+
+        // output and the first wavefront: object voxels next to the background.
+        OutputIteratorType outIt(m_Output, region);
+        for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt) {
+            const IndexType index = outIt.GetIndex();
+            const OffsetValueType offset = m_Output->ComputeOffset(index);
+            if (buffer[offset] == 0) {
+                outIt.Set(m_OutsideValue);
+                continue;
+            }
+            outIt.Set(m_InsideValue);
+            for (const auto &neighbour: neighbours) {
+                const IndexType n = index + neighbour;
+                if (region.IsInside(n) && buffer[m_Output->ComputeOffset(n)] == 0) {
+                    enqueue(offset, 0);
+                    break;
+                }
+            }
+        }
+
+        for (std::size_t d = 0; d < buckets.size() && d < maximumDepth; ++d) {
+            // the bucket can grow while it is processed, index it.
+            for (std::size_t k = 0; k < buckets[d].size(); ++k) {
+                const OffsetValueType offset = buckets[d][k];
+                const IndexType index = m_Output->ComputeIndex(offset);
+                if (isRemovable(index)) {
+                    m_Output->SetPixel(index, m_OutsideValue);
+                    this->RecordRemoval(index, static_cast<InternalPixelType>(
+                            std::floor(static_cast<double>(d) / 3.0) + 1));
+                    ++this->m_RemoveCount;
+                }
+                ++this->m_Count;
+                for (const auto &neighbour: neighbours) {
+                    const IndexType n = index + neighbour;
+                    if (!region.IsInside(n)) continue;
+                    const OffsetValueType nOffset = m_Output->ComputeOffset(n);
+                    if (buffer[nOffset] > 0 && buffer[nOffset] < unreached) {
+                        enqueue(nOffset, static_cast<IntegerDistanceType>(d));
+                    }
+                }
+            }
+            std::vector<OffsetValueType>().swap(buckets[d]);
+        }
+        this->FinalizeRemovalDistance();
         itkDebugMacro("Removed " + std::to_string(this->m_RemoveCount) + " of " + std::to_string(this->m_Count) + " voxels");
     }
 
+    template< class InputPixelType, class OutputPixelType>
+    void
+    HomotopicThinningImageFilter<InputPixelType , 3, OutputPixelType>::GenerateDataDirectional() {
+        this->AllocateOutputs();
+        const InputImageType *input = this->GetInput(0);
+        this->m_Output = this->GetOutput(0);
+        this->m_RemoveCount = 0;
+        this->m_Count = 0;
+
+        using RegionType = typename OutputImageType::RegionType;
+        const RegionType region = m_Output->GetRequestedRegion();
+        MultiThreaderBase *multiThreader = this->GetMultiThreader();
+        const SizeValueType numberOfChunks = std::max<SizeValueType>(1, this->GetNumberOfWorkUnits());
+
+        const std::array<Offset<3>, 6> faces = {{{{-1, 0, 0}}, {{1, 0, 0}}, {{0, -1, 0}},
+                                                 {{0, 1, 0}}, {{0, 0, -1}}, {{0, 0, 1}}}};
+        auto isObject = [&](const IndexType &index) {
+            return region.IsInside(index) && m_Output->GetPixel(index) != m_OutsideValue;
+        };
+        auto isBorder = [&](const IndexType &index) {
+            for (const auto &face: faces) {
+                if (!isObject(index + face)) return true;
+            }
+            return false;
+        };
+        // run f(begin, end, chunk) over numberOfChunks contiguous pieces of [0, n).
+        auto parallelChunks = [&](SizeValueType n, const std::function<void(SizeValueType, SizeValueType,
+                                                                             SizeValueType)> &f) {
+            multiThreader->ParallelizeArray(0, numberOfChunks, [&](SizeValueType chunk) {
+                f(chunk * n / numberOfChunks, (chunk + 1) * n / numberOfChunks, chunk);
+            }, nullptr);
+        };
+
+        // object and its first border, gathered per region chunk.
+        std::vector<OffsetValueType> border;
+        std::mutex borderMutex;
+        multiThreader->template ParallelizeImageRegion<3>(region, [&](const RegionType &chunkRegion) {
+            ImageRegionConstIterator<InputImageType> inIt(input, chunkRegion);
+            OutputIteratorType outIt(m_Output, chunkRegion);
+            for (; !outIt.IsAtEnd(); ++inIt, ++outIt) {
+                outIt.Set(inIt.Get() >= m_LowerThreshold ? m_InsideValue : m_OutsideValue);
+            }
+        }, nullptr);
+        multiThreader->template ParallelizeImageRegion<3>(region, [&](const RegionType &chunkRegion) {
+            std::vector<OffsetValueType> local;
+            OutputIteratorType outIt(m_Output, chunkRegion);
+            for (; !outIt.IsAtEnd(); ++outIt) {
+                if (outIt.Get() != m_OutsideValue && isBorder(outIt.GetIndex())) {
+                    local.push_back(m_Output->ComputeOffset(outIt.GetIndex()));
+                }
+            }
+            std::lock_guard<std::mutex> lock(borderMutex);
+            border.insert(border.end(), local.begin(), local.end());
+        }, nullptr);
+        std::sort(border.begin(), border.end());
+        this->InitializeRemovalDistance();
+
+        std::vector<std::vector<OffsetValueType>> removed(numberOfChunks);
+        for (unsigned layer = 0; layer < m_MaxIterations && !border.empty(); ++layer) {
+            SizeValueType layerRemoved = 0;
+            for (const auto &face: faces) {
+                for (unsigned subfield = 0; subfield < 8; ++subfield) {
+                    parallelChunks(border.size(), [&](SizeValueType begin, SizeValueType end, SizeValueType chunk) {
+                        for (SizeValueType i = begin; i < end; ++i) {
+                            const IndexType index = m_Output->ComputeIndex(border[i]);
+                            const unsigned parity = (index[0] & 1) | ((index[1] & 1) << 1) | ((index[2] & 1) << 2);
+                            if (parity != subfield || m_Output->GetPixel(index) == m_OutsideValue ||
+                                isObject(index + face)) {
+                                continue;
+                            }
+                            if (isRemovable(index)) {
+                                m_Output->SetPixel(index, m_OutsideValue);
+                                this->RecordRemoval(index, static_cast<InternalPixelType>(layer + 1));
+                                removed[chunk].push_back(border[i]);
+                            }
+                        }
+                    });
+                }
+            }
+
+            // next border: remaining border voxels and the object neighbours of removed ones.
+            std::vector<OffsetValueType> next;
+            for (const OffsetValueType offset: border) {
+                if (m_Output->GetPixel(m_Output->ComputeIndex(offset)) != m_OutsideValue) next.push_back(offset);
+            }
+            for (auto &chunkRemoved: removed) {
+                layerRemoved += chunkRemoved.size();
+                for (const OffsetValueType offset: chunkRemoved) {
+                    const IndexType index = m_Output->ComputeIndex(offset);
+                    for (const auto &face: faces) {
+                        if (isObject(index + face)) next.push_back(m_Output->ComputeOffset(index + face));
+                    }
+                }
+                chunkRemoved.clear();
+            }
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+            this->m_Count += border.size();
+            this->m_RemoveCount += layerRemoved;
+            border.swap(next);
+            itkDebugMacro("Layer " << layer << " removed " << layerRemoved << " voxels");
+            if (layerRemoved == 0) break;
+        }
+        this->FinalizeRemovalDistance();
+        itkDebugMacro("Removed " + std::to_string(this->m_RemoveCount) + " voxels");
+    }
+
     template< class InputPixelType, class OutputPixelType>
     bool
     HomotopicThinningImageFilter<InputPixelType , 2, OutputPixelType>::isSimple2(IndexType index){
@@ -0,0 +1,163 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+#ifndef SKELTOOLS_itkLazyAverageOutwardFlux_h
+#define SKELTOOLS_itkLazyAverageOutwardFlux_h
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImage.h>
+#include <itkOffset.h>
+#include <itkVector.h>
+
+#include "sphere.h"
+#include "itkAverageOutwardFluxKernel.h"
+
+namespace itk {
+
+/// \brief Average outward flux evaluated on demand.
+/// Holds a float spoke field or a closest point transform (itk::Offset pixels, e.g. the vector
+/// map of SeparableDistanceMapImageFilter) and computes the flux of a voxel the first
+/// time it is asked for, memoising it. Values are those of SpokeFieldToAverageOutwardFluxImageFilter
+/// with the same samples, distance image and thresholds, so filters that only read the AOF at a
+/// few voxels (the anchor test of the AOF anchored skeletons) skip the full volume AOF pass.
+/// This saves compute, not memory: the spokes (a closest point transform is D offsets per voxel)
+/// stay alive for the whole run, where the eager path keeps only the float AOF. The memo is block
+/// sparse, so it only grows with the blocks actually read. Evaluate may be called concurrently:
+/// blocks are installed with a compare and swap and values stored atomically, without a lock.
+    template<unsigned VDimension>
+    class ITK_TEMPLATE_EXPORT LazyAverageOutwardFlux : public Object {
+    public:
+        /** Standard class typedefs. */
+        using Self = LazyAverageOutwardFlux;
+        using Superclass = Object;
+        using Pointer = SmartPointer<Self>;
+        using ConstPointer = SmartPointer<const Self>;
+
+        static constexpr unsigned Dimension = VDimension;
+
+        /** Method for creation through the object factory */
+        itkNewMacro(Self);
+
+        /** Run-time type information (and related methods). */
+        itkTypeMacro(LazyAverageOutwardFlux, Object);
+
+        using SpokeFieldType = Image<Vector<float, VDimension>, VDimension>;
+        using ClosestPointTransformType = Image<Offset<VDimension>, VDimension>;
+        using DistanceImageType = Image<float, VDimension>;
+        using AOFValueType = float;
+        using AOFImageType = Image<AOFValueType, VDimension>;
+        using IndexType = typename AOFImageType::IndexType;
+        using RegionType = typename AOFImageType::RegionType;
+
+        /// Edge length in voxels of the memo blocks.
+        static constexpr unsigned MemoBlockSize = 8;
+
+        /// Spokes to evaluate the flux of, either a float spoke field or a closest point
+        /// transform. Setting one clears the other and the memo.
+        void SetSpokeField(const SpokeFieldType *spokes);
+        void SetClosestPointTransform(const ClosestPointTransformType *closestPoints);
+
+        /// Optional signed distance (inside negative), used as by the AOF filter: the flux is only
+        /// evaluated where the distance is below DistanceThreshold (default 0), elsewhere it is
+        /// OutsideValue, and spokes where it is not below SpokeDistanceThreshold (default: no
+        /// gating) are read as zero.
+        void SetDistanceImage(const DistanceImageType *distance);
+        itkSetMacro(DistanceThreshold, double);
+        itkGetConstMacro(DistanceThreshold, double);
+        itkSetMacro(SpokeDistanceThreshold, double);
+        itkGetConstMacro(SpokeDistanceThreshold, double);
+        itkSetMacro(OutsideValue, AOFValueType);
+        itkGetConstMacro(OutsideValue, AOFValueType);
+
+        /// Number of sphere samples the flux values are normalized to, as in the AOF filters.
+        static constexpr unsigned ReferenceNumberOfSamples = 60;
+
+        /// Sphere samples and shell radii, as in SpokeFieldToAverageOutwardFluxImageFilter.
+        void SetNumberOfSamples(unsigned numberOfSamples);
+        itkGetConstMacro(NumberOfSamples, unsigned);
+        void SetShellRadii(const std::vector<double> &radii);
+        const std::vector<double> &GetShellRadii() const { return m_ShellRadii; }
+
+        /// Adaptive sampling against thresholds on the AOF, as in the AOF filters. Takes effect with
+        /// the next Reset (setting the spokes resets).
+        void SetAdaptiveThresholds(const std::vector<double> &thresholds) { m_AdaptiveThresholds = thresholds; }
+        const std::vector<double> &GetAdaptiveThresholds() const { return m_AdaptiveThresholds; }
+        itkSetMacro(AdaptiveConfidence, double);
+        itkGetConstMacro(AdaptiveConfidence, double);
+
+        /// Flux at index, computed on first use (OutsideValue outside the distance threshold is
+        /// not memoised). Changing the distance, thresholds or samples needs a Reset of the memo.
+        AOFValueType Evaluate(const IndexType &index);
+
+        /// Drop all memoised values (the memo covers the buffered region of the spokes).
+        void Reset();
+
+        SizeValueType GetNumberOfEvaluations() const { return m_NumberOfEvaluations; }
+        SizeValueType GetNumberOfMemoBlocks() const { return m_NumberOfMemoBlocks; }
+
+    protected:
+        LazyAverageOutwardFlux();
+        ~LazyAverageOutwardFlux() override;
+
+        void PrintSelf(std::ostream &os, Indent indent) const override;
+
+    private:
+        template<typename TSpokeImage>
+        double Compute(const TSpokeImage *spokes, const IndexType &index) const;
+
+        using MemoValueType = std::atomic<AOFValueType>;
+        /// Block holding index and the position of index in it.
+        std::pair<SizeValueType, SizeValueType> ComputeMemoLocation(const IndexType &index) const;
+        /// Block b, allocated (NaN filled) and installed if no thread did so yet.
+        MemoValueType *GetOrAllocateMemoBlock(SizeValueType b);
+        void ReleaseMemo();
+
+        typename SpokeFieldType::ConstPointer m_SpokeField;
+        typename ClosestPointTransformType::ConstPointer m_ClosestPointTransform;
+        typename DistanceImageType::ConstPointer m_Distance;
+        // one pointer per block of the memo region, null until a value of the block is stored.
+        std::unique_ptr<std::atomic<MemoValueType *>[]> m_MemoBlocks;
+        RegionType m_MemoRegion;
+        Size<VDimension> m_MemoBlocksPerDimension;
+        SizeValueType m_NumberOfBlocks;
+        std::atomic<SizeValueType> m_NumberOfMemoBlocks;
+
+        AverageOutwardFluxKernel<VDimension> m_Kernel;
+        unsigned m_NumberOfSamples;
+        std::vector<double> m_ShellRadii;
+        std::vector<double> m_AdaptiveThresholds;
+        double m_AdaptiveConfidence;
+        double m_DistanceThreshold;
+        double m_SpokeDistanceThreshold;
+        AOFValueType m_OutsideValue;
+        std::atomic<SizeValueType> m_NumberOfEvaluations;
+    };
+
+} // end namespace itk
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLazyAverageOutwardFlux.hxx"
+#endif
+
+#endif //SKELTOOLS_itkLazyAverageOutwardFlux_h
@@ -0,0 +1,229 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+#ifndef SKELTOOLS_itkLazyAverageOutwardFlux_hxx
+#define SKELTOOLS_itkLazyAverageOutwardFlux_hxx
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "itkLazyAverageOutwardFlux.h"
+
+namespace itk {
+    template<unsigned VDimension>
+    LazyAverageOutwardFlux<VDimension>::LazyAverageOutwardFlux() {
+        m_SpokeField = nullptr;
+        m_ClosestPointTransform = nullptr;
+        m_Distance = nullptr;
+        m_MemoBlocks = nullptr;
+        m_MemoBlocksPerDimension.Fill(0);
+        m_NumberOfBlocks = 0;
+        m_NumberOfMemoBlocks = 0;
+        m_DistanceThreshold = 0.0;
+        m_SpokeDistanceThreshold = NumericTraits<double>::max();
+        m_OutsideValue = NumericTraits<AOFValueType>::ZeroValue();
+        m_ShellRadii = {1.0};
+        m_AdaptiveConfidence = 3.0;
+        m_NumberOfSamples = 0;
+        m_NumberOfEvaluations = 0;
+        this->SetNumberOfSamples(ReferenceNumberOfSamples);
+    }
+
+    template<unsigned VDimension>
+    LazyAverageOutwardFlux<VDimension>::~LazyAverageOutwardFlux() {
+        this->ReleaseMemo();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::SetSpokeField(const SpokeFieldType *spokes) {
+        m_SpokeField = spokes;
+        m_ClosestPointTransform = nullptr;
+        this->Reset();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::SetClosestPointTransform(const ClosestPointTransformType *closestPoints) {
+        m_ClosestPointTransform = closestPoints;
+        m_SpokeField = nullptr;
+        this->Reset();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::SetDistanceImage(const DistanceImageType *distance) {
+        m_Distance = distance;
+        this->Modified();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::SetNumberOfSamples(unsigned numberOfSamples) {
+        if (numberOfSamples == 0) {
+            itkExceptionMacro("Number of sphere samples must be positive.");
+        }
+        if (numberOfSamples == m_NumberOfSamples) return;
+        m_NumberOfSamples = numberOfSamples;
+        m_Kernel.SetSamples(sphere::Samples<VDimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::SetShellRadii(const std::vector<double> &radii) {
+        if (radii.empty() || *std::min_element(radii.begin(), radii.end()) <= 0) {
+            itkExceptionMacro("Shell radii must be positive.");
+        }
+        if (radii == m_ShellRadii) return;
+        m_ShellRadii = radii;
+        m_Kernel.SetSamples(sphere::Samples<VDimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::Reset() {
+        m_NumberOfEvaluations = 0;
+        m_Kernel.SetAdaptive(m_AdaptiveThresholds,
+                             static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples(),
+                             m_AdaptiveConfidence);
+        const ImageBase<VDimension> *spokes = m_SpokeField
+                ? static_cast<const ImageBase<VDimension> *>(m_SpokeField.GetPointer())
+                : m_ClosestPointTransform.GetPointer();
+        this->ReleaseMemo();
+        if (!spokes) return;
+        m_MemoRegion = spokes->GetBufferedRegion();
+        m_NumberOfBlocks = 1;
+        for (unsigned d = 0; d < VDimension; ++d) {
+            m_MemoBlocksPerDimension[d] = (m_MemoRegion.GetSize(d) + MemoBlockSize - 1) / MemoBlockSize;
+            m_NumberOfBlocks *= m_MemoBlocksPerDimension[d];
+        }
+        m_MemoBlocks.reset(new std::atomic<MemoValueType *>[m_NumberOfBlocks]);
+        for (SizeValueType b = 0; b < m_NumberOfBlocks; ++b) {
+            m_MemoBlocks[b].store(nullptr, std::memory_order_relaxed);
+        }
+        this->Modified();
+    }
+
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::ReleaseMemo() {
+        if (m_MemoBlocks) {
+            for (SizeValueType b = 0; b < m_NumberOfBlocks; ++b) {
+                delete[] m_MemoBlocks[b].load(std::memory_order_relaxed);
+            }
+        }
+        m_MemoBlocks = nullptr;
+        m_NumberOfBlocks = 0;
+        m_NumberOfMemoBlocks = 0;
+    }
+
+    template<unsigned VDimension>
+    std::pair<SizeValueType, SizeValueType>
+    LazyAverageOutwardFlux<VDimension>::ComputeMemoLocation(const IndexType &index) const {
+        SizeValueType block = 0;
+        SizeValueType position = 0;
+        for (int d = VDimension - 1; d >= 0; --d) {
+            const auto local = static_cast<SizeValueType>(index[d] - m_MemoRegion.GetIndex(d));
+            block = block * m_MemoBlocksPerDimension[d] + local / MemoBlockSize;
+            position = position * MemoBlockSize + local % MemoBlockSize;
+        }
+        return {block, position};
+    }
+
+    template<unsigned VDimension>
+    typename LazyAverageOutwardFlux<VDimension>::MemoValueType *
+    LazyAverageOutwardFlux<VDimension>::GetOrAllocateMemoBlock(SizeValueType b) {
+        MemoValueType *block = m_MemoBlocks[b].load(std::memory_order_acquire);
+        if (block) return block;
+        SizeValueType volume = 1;
+        for (unsigned d = 0; d < VDimension; ++d) volume *= MemoBlockSize;
+        auto *allocated = new MemoValueType[volume];
+        for (SizeValueType i = 0; i < volume; ++i) {
+            allocated[i].store(std::numeric_limits<AOFValueType>::quiet_NaN(), std::memory_order_relaxed);
+        }
+        // a thread that lost the race uses the block installed by the winner.
+        if (m_MemoBlocks[b].compare_exchange_strong(block, allocated, std::memory_order_acq_rel,
+                                                    std::memory_order_acquire)) {
+            m_NumberOfMemoBlocks.fetch_add(1, std::memory_order_relaxed);
+            return allocated;
+        }
+        delete[] allocated;
+        return block;
+    }
+
+    template<unsigned VDimension>
+    template<typename TSpokeImage>
+    double
+    LazyAverageOutwardFlux<VDimension>::Compute(const TSpokeImage *spokes, const IndexType &index) const {
+        const double scale = static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples();
+        if (m_Distance && m_SpokeDistanceThreshold < NumericTraits<double>::max()) {
+            const auto spokeThreshold = static_cast<typename DistanceImageType::PixelType>(m_SpokeDistanceThreshold);
+            const DistanceImageType *distance = m_Distance;
+            return scale * m_Kernel.EvaluateClamped(spokes, index, [distance, spokeThreshold](const IndexType &q) {
+                return distance->GetPixel(q) < spokeThreshold;
+            });
+        }
+        return scale * m_Kernel.EvaluateClamped(spokes, index, [](const IndexType &) { return true; });
+    }
+
+    template<unsigned VDimension>
+    typename LazyAverageOutwardFlux<VDimension>::AOFValueType
+    LazyAverageOutwardFlux<VDimension>::Evaluate(const IndexType &index) {
+        const auto threshold = static_cast<typename DistanceImageType::PixelType>(m_DistanceThreshold);
+        if (m_Distance && !(m_Distance->GetPixel(index) < threshold)) return m_OutsideValue;
+        const auto location = this->ComputeMemoLocation(index);
+        if (const MemoValueType *block = m_MemoBlocks[location.first].load(std::memory_order_acquire)) {
+            const AOFValueType value = block[location.second].load(std::memory_order_relaxed);
+            if (!std::isnan(value)) return value;
+        }
+
+        // two threads asking for one voxel both compute it, they store the same value.
+        const auto value = static_cast<AOFValueType>(
+                m_SpokeField ? this->Compute(m_SpokeField.GetPointer(), index)
+                             : this->Compute(m_ClosestPointTransform.GetPointer(), index));
+        m_NumberOfEvaluations.fetch_add(1, std::memory_order_relaxed);
+        this->GetOrAllocateMemoBlock(location.first)[location.second].store(value, std::memory_order_relaxed);
+        return value;
+    }
+
+/**
+*  Print Self
+*/
+    template<unsigned VDimension>
+    void
+    LazyAverageOutwardFlux<VDimension>::PrintSelf(std::ostream &os, Indent indent) const {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "LazyAverageOutwardFlux: " << m_NumberOfEvaluations << " voxels evaluated in "
+           << m_NumberOfMemoBlocks << " of " << m_NumberOfBlocks << " memo blocks." << std::endl;
+        os << indent << "NumberOfSamples: " << m_NumberOfSamples << std::endl;
+        os << indent << "ShellRadii:";
+        for (double radius: m_ShellRadii) os << " " << radius;
+        os << std::endl;
+        os << indent << "AdaptiveThresholds:";
+        for (double threshold: m_AdaptiveThresholds) os << " " << threshold;
+        os << std::endl;
+        os << indent << "AdaptiveConfidence: " << m_AdaptiveConfidence << std::endl;
+        os << indent << "DistanceThreshold: " << m_DistanceThreshold << std::endl;
+        os << indent << "SpokeDistanceThreshold: " << m_SpokeDistanceThreshold << std::endl;
+        os << indent << "OutsideValue: " << m_OutsideValue << std::endl;
+    }
+}
+#endif //SKELTOOLS_itkLazyAverageOutwardFlux_hxx
@@ -29,6 +29,7 @@
 //#include <itkDanielssonDistanceMapImageFilter.h>
 #include <itkConstantBoundaryCondition.h>
 
+
 namespace itk {
     /// 1. manual instantation
     template<class TInputImage,
@@ -96,16 +97,75 @@ namespace itk {
         using HeapContainer = std::vector<Pixel>;
         using HeapType = std::priority_queue<Pixel, HeapContainer, Greater>;
 
+        using RankPixelType = unsigned int;
+        using RankImageType = Image<RankPixelType, Dimension>;
+        using RankImagePointerType = typename RankImageType::Pointer;
+
+        using BandPixelType = unsigned char;
+        using BandImageType = Image<BandPixelType, Dimension>;
+        using BandImagePointerType = typename BandImageType::Pointer;
+
+        /// Heap priority. Defaults to the distance image if not set.
         void SetPriorityImage(PriorityImagePointerType priorityImage){
             m_PriorityImage = priorityImage;
+            m_DefaultPriorityImage = false;
         }
         PriorityImagePointerType GetPriorityImage(){
             return m_PriorityImage;
         }
 
+        /// Distance to the object boundary (positive inside) used for radius weights.
+        /// Computed from the input if not set, and then recomputed on every update. Setting it
+        /// lets a filter run on a subset of an object (e.g. its medial surface) keep the
+        /// distances of the full object.
+        void SetDistanceImage(PriorityImagePointerType distanceImage){
+            m_DistanceImage = distanceImage;
+            m_ComputedDistanceImage = false;
+        }
+        PriorityImagePointerType GetDistanceImage(){
+            return m_DistanceImage;
+        }
+
+        /// Band (non zero voxels) expected to contain the skeleton, e.g. an upsampled coarse
+        /// skeleton. Simple, non end points outside the band are first removed in priority
+        /// order without seeding the band, ordered thinning then only has to process the band.
+        void SetBandImage(BandImagePointerType bandImage){
+            m_BandImage = bandImage;
+        }
+        BandImagePointerType GetBandImage(){
+            return m_BandImage;
+        }
+
+        /// Voxels (non zero) that are never removed, e.g. a shell of a previously computed
+        /// skeleton around a region being re-thinned.
+        void SetProtectedImage(BandImagePointerType protectedImage){
+            m_ProtectedImage = protectedImage;
+        }
+        BandImagePointerType GetProtectedImage(){
+            return m_ProtectedImage;
+        }
+
         itkSetMacro(RadiusWeightedSkeleton,bool);
         itkGetConstMacro(RadiusWeightedSkeleton, bool);
 
+        /// Pop all heap nodes of equal priority at once and process them in memory order,
+        /// with their neighbourhoods prefetched. Voxels pushed below the tie priority meanwhile
+        /// are still removed before the next tie voxel, so only the order within a tie (which is
+        /// arbitrary in the heap as well) changes; the result can differ from a run without
+        /// batching as any change of tie order can.
+        itkSetMacro(BatchTies, bool);
+        itkGetConstMacro(BatchTies, bool);
+        itkBooleanMacro(BatchTies);
+
+        /// Record the order in which voxels are deleted: 1 for the first removed voxel and so on,
+        /// max for voxels of the skeleton, 0 for the background.
+        itkSetMacro(ComputeRemovalRank, bool);
+        itkGetConstMacro(ComputeRemovalRank, bool);
+        itkBooleanMacro(ComputeRemovalRank);
+        RankImagePointerType GetRemovalRankImage(){
+            return m_RemovalRank;
+        }
+
     protected:
         OrderedSkeletonizationImageFilterBase();
         ~OrderedSkeletonizationImageFilterBase() = default;
@@ -114,14 +174,54 @@ namespace itk {
 
         virtual bool IsEnd(IndexType index) = 0;
         virtual void Initialize();
+        /// Distance image (computed if not set) and default priority.
+        PriorityImagePointerType ComputeDistanceImage();
+        /// Drop a computed distance image and a defaulted priority, which belong to the previous input.
+        void ReleaseComputedDistanceImage();
         OutputPointerType m_Skeleton;
 
         virtual bool IsSimple(IndexType index) = 0;
         virtual bool IsBoundary(IndexType index) = 0;
 
+        bool IsProtected(const IndexType &index) const {
+            return m_ProtectedImage != nullptr && m_ProtectedImage->GetPixel(index) != 0;
+        }
+
+        /// Priority ordered removal of simple, non end points outside the band.
+        void ThinOutsideBand();
+
+        /// Called once ordered thinning is done, ranks the remaining skeleton voxels.
+        virtual void FinalizeThinning();
+
+        /// Hint the cache about the 3^Dimension neighbourhood of the voxel at buffer offset.
+        void PrefetchNeighborhood(OffsetValueType offset) const;
+
+        void RecordRemoval(const IndexType &index) {
+            if (m_RemovalRank != nullptr) m_RemovalRank->SetPixel(index, ++m_NumberOfRemovals);
+        }
+
+        /// Allocate queued flags for the initialized skeleton.
+        void InitializeQueued();
+        bool IsQueued(const IndexType &index) const;
+        void SetQueued(const IndexType &index, bool queued);
+
+        /// Buffer offsets of the boundary voxels of the initialized skeleton, if Initialize
+        /// gathered them. Seeding the heap then iterates this list instead of scanning the output.
+        std::vector<OffsetValueType> m_BoundaryCandidates;
+        bool m_HasBoundaryCandidates;
+
         OutputPointerType m_Queued;
         PriorityImagePointerType m_PriorityImage;
+        PriorityImagePointerType m_DistanceImage;
+        BandImagePointerType m_BandImage;
+        BandImagePointerType m_ProtectedImage;
+        RankImagePointerType m_RemovalRank;
+        RankPixelType m_NumberOfRemovals;
+        bool m_ComputedDistanceImage;
+        bool m_DefaultPriorityImage;
         bool m_RadiusWeightedSkeleton;
+        bool m_ComputeRemovalRank;
+        bool m_BatchTies;
     };
 
 
@@ -19,8 +19,11 @@
 #ifndef SKELTOOLS_itkOrderedSkeletonizationImageFilterBase_hxx
 #define SKELTOOLS_itkOrderedSkeletonizationImageFilterBase_hxx
 
+#include <algorithm>
+#include <utility>
+
 #include <itkBinaryThresholdImageFilter.h>
-#include <itkDanielssonDistanceMapImageFilter.h>
+#include "itkSeparableDistanceMapImageFilter.h"
 
 #include "itkOrderedSkeletonizationImageFilterBase.h"
 #include "topology.h"
@@ -29,59 +32,143 @@ namespace itk {
     template<class TInputImage, class TOutputImage>
     OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::OrderedSkeletonizationImageFilterBase() {
         m_PriorityImage = nullptr;
+        m_DistanceImage = nullptr;
+        m_ComputedDistanceImage = false;
+        m_DefaultPriorityImage = false;
+        m_BandImage = nullptr;
+        m_ProtectedImage = nullptr;
+        m_RemovalRank = nullptr;
+        m_NumberOfRemovals = 0;
         m_RadiusWeightedSkeleton = true;
+        m_ComputeRemovalRank = false;
+        m_HasBoundaryCandidates = false;
+        m_BatchTies = false;
     }
 
     template<class TInputImage, class TOutputImage>
     void
-    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::Initialize() {
-        InputPointerType input = this->GetInput();
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::PrefetchNeighborhood(OffsetValueType offset) const {
+#if defined(__GNUC__) || defined(__clang__)
+        // one prefetch per row of the 3x3(x3) block, for the skeleton and the priority image.
+        const auto *skeleton = this->m_Skeleton->GetBufferPointer();
+        const bool samePriorityGrid =
+                this->m_PriorityImage->GetBufferedRegion() == this->m_Skeleton->GetBufferedRegion();
+        const auto *priority = this->m_PriorityImage->GetBufferPointer();
+        const OffsetValueType *offsetTable = this->m_Skeleton->GetOffsetTable();
+        const OffsetValueType numberOfPixels = offsetTable[Dimension];
+        unsigned rows = 1;
+        for (unsigned d = 1; d < Dimension; ++d) rows *= 3;
+        for (unsigned row = 0; row < rows; ++row) {
+            OffsetValueType rowOffset = offset - 1;
+            unsigned rest = row;
+            for (unsigned d = 1; d < Dimension; ++d) {
+                rowOffset += (static_cast<OffsetValueType>(rest % 3) - 1) * offsetTable[d];
+                rest /= 3;
+            }
+            if (rowOffset < 0 || rowOffset >= numberOfPixels) continue;
+            __builtin_prefetch(skeleton + rowOffset, 1);
+            if (samePriorityGrid) __builtin_prefetch(priority + rowOffset, 0);
+        }
+#else
+        (void)offset;
+#endif
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::InitializeQueued() {
+        this->m_Queued = TOutputImage::New();
+        this->m_Queued->SetSpacing(this->m_Skeleton->GetSpacing());
+        this->m_Queued->SetOrigin(this->m_Skeleton->GetOrigin());
+        this->m_Queued->SetRegions(this->m_Skeleton->GetRequestedRegion());
+        this->m_Queued->Allocate();
+        this->m_Queued->FillBuffer(0);
+
+        m_NumberOfRemovals = 0;
+        m_RemovalRank = nullptr;
+        if (m_ComputeRemovalRank) {
+            m_RemovalRank = RankImageType::New();
+            m_RemovalRank->CopyInformation(this->m_Skeleton);
+            m_RemovalRank->SetRegions(this->m_Skeleton->GetRequestedRegion());
+            m_RemovalRank->Allocate();
+            m_RemovalRank->FillBuffer(0);
+        }
+    }
+
+    template<class TInputImage, class TOutputImage>
+    bool
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::IsQueued(const IndexType &index) const {
+        return this->m_Queued->GetPixel(index) > 0;
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::SetQueued(const IndexType &index, bool queued) {
+        this->m_Queued->SetPixel(index, queued ? 1 : 0);
+    }
+
+    template<class TInputImage, class TOutputImage>
+    typename OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::PriorityImagePointerType
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::ComputeDistanceImage() {
+        if (m_DistanceImage == nullptr) {
+            using BinaryImageGeneratorType = BinaryThresholdImageFilter<TInputImage, TInputImage>;
+            typename BinaryImageGeneratorType::Pointer binaryImageGenerator = BinaryImageGeneratorType::New();
+            binaryImageGenerator->SetInput(this->GetInput());
+            binaryImageGenerator->SetLowerThreshold(NumericTraits<PixelType>::OneValue());
+            binaryImageGenerator->SetUpperThreshold(NumericTraits<PixelType>::max());
+            binaryImageGenerator->SetOutsideValue(NumericTraits<PixelType>::OneValue());
+            binaryImageGenerator->SetInsideValue(NumericTraits<PixelType>::ZeroValue());
+            binaryImageGenerator->Update();
 
-        using BinaryImageGeneratorType = BinaryThresholdImageFilter<TInputImage, TInputImage>;
-        typename BinaryImageGeneratorType::Pointer binaryImageGenerator = BinaryImageGeneratorType::New();
-        binaryImageGenerator->SetInput(input);
-        binaryImageGenerator->SetLowerThreshold(NumericTraits<PixelType>::OneValue());
-        binaryImageGenerator->SetUpperThreshold(NumericTraits<PixelType>::max());
-        binaryImageGenerator->SetOutsideValue(NumericTraits<PixelType>::OneValue());
-        binaryImageGenerator->SetInsideValue(NumericTraits<PixelType>::ZeroValue());
-        binaryImageGenerator->Update();
-        auto binaryInput = binaryImageGenerator->GetOutput();
-        PriorityImagePointerType distanceImage = nullptr;
-
-        if(m_PriorityImage == nullptr) {
-            using PriorityFilterType = DanielssonDistanceMapImageFilter<TInputImage, PriorityImageType>;
-            auto priorityFilter = PriorityFilterType::New();
-            priorityFilter->SetInput(binaryInput);
-            priorityFilter->UseImageSpacingOn();
-            priorityFilter->Update();
-            this->m_PriorityImage = priorityFilter->GetOutput();
-            m_PriorityImage->ReleaseDataFlagOff();
-            distanceImage = m_PriorityImage;
-        }else{
-            auto distanceFilter = DanielssonDistanceMapImageFilter<TInputImage, PriorityImageType>::New();
-            distanceFilter->SetInput(binaryInput);
+            using DistanceFilterType = SeparableDistanceMapImageFilter<TInputImage, PriorityImageType>;
+            auto distanceFilter = DistanceFilterType::New();
+            distanceFilter->SetInput(binaryImageGenerator->GetOutput());
+            distanceFilter->SignedOff();
             distanceFilter->UseImageSpacingOn();
             distanceFilter->Update();
-            distanceImage = distanceFilter->GetOutput();
+            m_DistanceImage = distanceFilter->GetOutput();
+            m_DistanceImage->ReleaseDataFlagOff();
+            m_ComputedDistanceImage = true;
         }
+        if (m_PriorityImage == nullptr) {
+            m_PriorityImage = m_DistanceImage;
+            m_DefaultPriorityImage = true;
+        }
+        return m_DistanceImage;
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::ReleaseComputedDistanceImage() {
+        if (m_ComputedDistanceImage) {
+            m_DistanceImage = nullptr;
+            m_ComputedDistanceImage = false;
+        }
+        if (m_DefaultPriorityImage) {
+            m_PriorityImage = nullptr;
+            m_DefaultPriorityImage = false;
+        }
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::Initialize() {
+        InputPointerType input = this->GetInput();
+        PriorityImagePointerType distanceImage = this->ComputeDistanceImage();
         assert(distanceImage != nullptr && "Distance image cannot be nullptr\n");
 
         this->m_Skeleton = this->GetOutput();
         this->AllocateOutputs();
 
-        this->m_Queued = TOutputImage::New();
-        this->m_Queued->SetSpacing(this->m_PriorityImage->GetSpacing());
-        this->m_Queued->SetOrigin(this->m_PriorityImage->GetOrigin());
-        this->m_Queued->SetRegions(this->m_PriorityImage->GetRequestedRegion());
-        this->m_Queued->Allocate();
-
         OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetLargestPossibleRegion());
+        InputConstIteratorType inIt(input, this->m_Skeleton->GetLargestPossibleRegion());
         PriorityImageConstIteratorType dIt(distanceImage, distanceImage->GetLargestPossibleRegion() );
         dIt.GoToBegin();
+        inIt.GoToBegin();
         skit.GoToBegin();
         while (!skit.IsAtEnd()) {
             PriorityValueType value = dIt.Get();
-            if(value > 0) {
+            if(inIt.Get() >= NumericTraits<PixelType>::OneValue() && value > 0) {
                 if(this->m_RadiusWeightedSkeleton) {
                     skit.Set(value);
                 }else{
@@ -91,92 +178,191 @@ namespace itk {
                 skit.Set(0);
             }
             ++dIt;
+            ++inIt;
             ++skit;
         }
+        this->InitializeQueued();
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::ThinOutsideBand() {
+        typename OutputNeighborhoodIteratorType::RadiusType radius;
+        radius.Fill(1);
+        OutputNeighborhoodIteratorType sknit(radius, this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
+
+        // same priority order as the ordered thinning: in arbitrary (breadth first) order, voxels
+        // of a branch that ordered thinning would erode become end points first and survive as spurs.
+        HeapType heap;
+        Pixel node;
+        auto push = [&](const IndexType &index) {
+            node.SetIndex(index);
+            node.SetValue(this->m_PriorityImage->GetPixel(index));
+            heap.push(node);
+            this->SetQueued(index, true);
+        };
+        IndexType q, r;
+        OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
+        for (skit.GoToBegin(); !skit.IsAtEnd(); ++skit) {
+            q = skit.GetIndex();
+            if (this->m_BandImage->GetPixel(q) == 0 && this->IsBoundary(q) && this->IsSimple(q)) {
+                push(q);
+            }
+        }
+
+        SizeValueType removed = 0;
+        while (!heap.empty()) {
+            node = heap.top();
+            heap.pop();
+            q = node.GetIndex();
+            this->SetQueued(q, false);
+            if (this->IsProtected(q) || !this->IsSimple(q) || this->IsEnd(q)) continue;
+
+            sknit.SetLocation(q);
+            sknit.SetCenterPixel(0);
+            this->RecordRemoval(q);
+            ++removed;
+            for (unsigned int i = 0; i < sknit.Size(); i++) {
+                if (sknit.GetPixel(i) > 0) {
+                    r = sknit.GetIndex(i);
+                    if (this->m_BandImage->GetPixel(r) == 0 && !this->IsQueued(r) && this->IsSimple(r)) {
+                        push(r);
+                    }
+                }
+            }
+        }
+        itkDebugMacro("Removed " << removed << " voxels outside the band");
     }
 
     template<class TInputImage, class TOutputImage>
     void
     OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::GenerateData() {
+        m_HasBoundaryCandidates = false;
+        this->ReleaseComputedDistanceImage();
         Initialize();
 
-        //Iterators
-        PriorityImageConstIteratorType dit(this->m_PriorityImage, this->m_PriorityImage->GetRequestedRegion());
-        OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
-        OutputIteratorType qit(this->m_Queued, this->m_Queued->GetRequestedRegion());
+        if (this->m_BandImage != nullptr) {
+            this->ThinOutsideBand();
+        }
 
+        //Iterators
         typename OutputNeighborhoodIteratorType::RadiusType radius;
         radius.Fill(1);
         PriorityNeighborhoodIteratorType dnit(radius, this->m_PriorityImage,
                                               this->m_PriorityImage->GetRequestedRegion());
         radius.Fill(1);
         OutputNeighborhoodIteratorType sknit(radius, this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
-        radius.Fill(1);
-        OutputNeighborhoodIteratorType qnit(radius, this->m_Queued, this->m_Queued->GetRequestedRegion());
 
         //First step...
-        IndexType q;
         PriorityValueType priority = 0;
         HeapType heap;
         Pixel node;
 
-        for (skit.GoToBegin(), dit.GoToBegin(), qit.GoToBegin();
-             !skit.IsAtEnd() && !dit.IsAtEnd() && !qit.IsAtEnd(); ++skit, ++dit, ++qit) {
-            q = skit.GetIndex();
-            if (this->IsBoundary(q)) {
-                if (IsSimple(q)) {
-                    //Simple pixel
-                    node.SetIndex(q);
-                    priority = dit.Get();
-                    node.SetValue(priority);
-                    heap.push(node);
-                    qit.Set(1);
-                } else qit.Set(0);
-            } else {
-                qit.Set(0);
+        auto seed = [&](const IndexType &index) {
+            if (this->IsSimple(index)) {
+                //Simple pixel
+                node.SetIndex(index);
+                node.SetValue(this->m_PriorityImage->GetPixel(index));
+                heap.push(node);
+                this->SetQueued(index, true);
+            }
+        };
+        // band thinning changes the boundary, gathered candidates are only valid without it.
+        if (m_HasBoundaryCandidates && this->m_BandImage == nullptr) {
+            for (const OffsetValueType candidate: m_BoundaryCandidates) {
+                seed(this->m_Skeleton->ComputeIndex(candidate));
+            }
+        } else {
+            OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
+            for (skit.GoToBegin(); !skit.IsAtEnd(); ++skit) {
+                if (this->IsBoundary(skit.GetIndex())) seed(skit.GetIndex());
             }
         }
+        std::vector<OffsetValueType>().swap(m_BoundaryCandidates);
 
         //Second step
 
         IndexType r;
 
-        while (!heap.empty()) {
-
-            node = heap.top();
-            heap.pop();
-
-            q = node.GetIndex();
-
-            qnit.SetLocation(q);
-            qnit.SetCenterPixel(0);
+        auto process = [&](const IndexType &q) {
+            this->SetQueued(q, false);
 
             if (this->IsSimple(q)) {
-                if (this->IsEnd(q)) {
+                if (this->IsProtected(q) || this->IsEnd(q)) {
                     //do nothing
                 } else {
                     sknit.SetLocation(q);
                     sknit.SetCenterPixel(0); //Deletion from object
+                    this->RecordRemoval(q);
                     dnit.SetLocation(q);
 
                     for (unsigned int i = 0; i < sknit.Size(); i++) {
                         if (sknit.GetPixel(i) > 0) {
                             //Object pixel
                             r = sknit.GetIndex(i);
-                            if (qnit.GetPixel(i) == 0) {
+                            if (!this->IsQueued(r)) {
                                 //Not queued pixel
                                 if (this->IsSimple(r)) {
                                     priority = dnit.GetPixel(i);
                                     node.SetIndex(r);
                                     node.SetValue(priority);
                                     heap.push(node);
-                                    qnit.SetPixel(i, 1);
+                                    this->SetQueued(r, true);
                                 }
                             }
                         }
                     }
                 }
             }
+        };
+
+        if (!m_BatchTies) {
+            while (!heap.empty()) {
+                node = heap.top();
+                heap.pop();
+                process(node.GetIndex());
+            }
+        } else {
+            // removal order within a priority tie is arbitrary: take the whole tie, visit it
+            // in memory order and fetch the neighbourhoods ahead of the topology tests.
+            std::vector<std::pair<OffsetValueType, IndexType>> batch;
+            while (!heap.empty()) {
+                node = heap.top();
+                const PriorityValueType tie = node.GetPriority();
+                batch.clear();
+                while (!heap.empty() && heap.top().GetPriority() == tie) {
+                    node = heap.top();
+                    heap.pop();
+                    batch.emplace_back(this->m_Skeleton->ComputeOffset(node.GetIndex()), node.GetIndex());
+                }
+                std::sort(batch.begin(), batch.end(),
+                          [](const std::pair<OffsetValueType, IndexType> &a,
+                             const std::pair<OffsetValueType, IndexType> &b) { return a.first < b.first; });
+                for (const auto &entry: batch) {
+                    this->PrefetchNeighborhood(entry.first);
+                }
+                for (const auto &entry: batch) {
+                    // removals push neighbours that may rank below the tie, those still go first.
+                    while (!heap.empty() && heap.top().GetPriority() < tie) {
+                        node = heap.top();
+                        heap.pop();
+                        process(node.GetIndex());
+                    }
+                    process(entry.second);
+                }
+            }
+        }
+        this->FinalizeThinning();
+    }
+
+    template<class TInputImage, class TOutputImage>
+    void
+    OrderedSkeletonizationImageFilterBase<TInputImage, TOutputImage>::FinalizeThinning() {
+        if (m_RemovalRank == nullptr) return;
+        OutputIteratorType skit(this->m_Skeleton, this->m_Skeleton->GetRequestedRegion());
+        ImageRegionIterator<RankImageType> rit(m_RemovalRank, this->m_Skeleton->GetRequestedRegion());
+        for (skit.GoToBegin(), rit.GoToBegin(); !skit.IsAtEnd(); ++skit, ++rit) {
+            if (skit.Get() > 0 && rit.Get() == 0) rit.Set(NumericTraits<RankPixelType>::max());
         }
     }
 }
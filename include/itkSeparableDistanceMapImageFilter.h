@@ -0,0 +1,126 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+#ifndef SKELTOOLS_itkSeparableDistanceMapImageFilter_h
+#define SKELTOOLS_itkSeparableDistanceMapImageFilter_h
+
+#include <vector>
+
+#include <itkImage.h>
+#include <itkImageToImageFilter.h>
+#include <itkOffset.h>
+
+namespace itk {
+
+/// \brief Exact Euclidean distance and feature (closest point) transform, multithreaded.
+/// Features are the non zero input voxels. The transform is separable: the nearest feature is
+/// found along the lines of the first axis, then every further axis takes the lower envelope of
+/// the parabolas of the previous axis (Felzenszwalb and Huttenlocher, as in Maurer's EDT), each
+/// axis processes its lines in parallel. Only the nearest feature of every voxel is stored.
+///
+/// Outputs follow SignedDanielssonDistanceMapImageFilter so it can be used in its place: the
+/// distance map (output 0) and the offset of every voxel to its nearest feature (vector map,
+/// output 1). Signed (default), the distance of non feature voxels is positive and that of
+/// feature voxels is the negated distance to the non feature voxels dilated by one voxel (face
+/// neighbours), InsideIsPositive flips the sign. Unsigned, it is the distance to the features
+/// (0 on them) as DanielssonDistanceMapImageFilter. Unlike Danielsson's the distances are exact.
+    template<typename TInputImage, typename TOutputImage = Image<float, TInputImage::ImageDimension>>
+    class ITK_TEMPLATE_EXPORT SeparableDistanceMapImageFilter : public ImageToImageFilter<TInputImage, TOutputImage> {
+    public:
+        /** Standard class typedefs. */
+        using Self = SeparableDistanceMapImageFilter;
+        using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+        using Pointer = SmartPointer<Self>;
+        using ConstPointer = SmartPointer<const Self>;
+
+        static constexpr unsigned ImageDimension = TInputImage::ImageDimension;
+
+        /** Method for creation through the object factory */
+        itkNewMacro(Self);
+
+        /** Run-time type information (and related methods). */
+        itkTypeMacro(SeparableDistanceMapImageFilter, ImageToImageFilter);
+
+        using InputImageType = TInputImage;
+        using OutputImageType = TOutputImage;
+        using OutputPixelType = typename OutputImageType::PixelType;
+        using VectorImageType = Image<Offset<ImageDimension>, ImageDimension>;
+        using VectorImagePointer = typename VectorImageType::Pointer;
+        using DataObjectPointer = typename Superclass::DataObjectPointer;
+        using DataObjectPointerArraySizeType = typename Superclass::DataObjectPointerArraySizeType;
+
+        /// Signed distance (default) or distance to the features only.
+        itkSetMacro(Signed, bool);
+        itkGetConstMacro(Signed, bool);
+        itkBooleanMacro(Signed);
+
+        /// Feature voxels negative (default) or positive in the signed distance.
+        itkSetMacro(InsideIsPositive, bool);
+        itkGetConstMacro(InsideIsPositive, bool);
+        itkBooleanMacro(InsideIsPositive);
+
+        /// Distances in physical units (default) or in voxels. Offsets are always in voxels.
+        itkSetMacro(UseImageSpacing, bool);
+        itkGetConstMacro(UseImageSpacing, bool);
+        itkBooleanMacro(UseImageSpacing);
+
+        OutputImageType *GetDistanceMap() { return this->GetOutput(); }
+
+        /// Offset from every voxel to its nearest feature voxel.
+        VectorImageType *GetVectorDistanceMap();
+
+        using Superclass::MakeOutput;
+        DataObjectPointer MakeOutput(DataObjectPointerArraySizeType idx) override;
+
+    protected:
+        SeparableDistanceMapImageFilter();
+        ~SeparableDistanceMapImageFilter() override = default;
+
+        /// The transform is global, the whole input is needed and the whole output produced.
+        void GenerateInputRequestedRegion() override;
+        void EnlargeOutputRequestedRegion(DataObject *data) override;
+
+        void GenerateData() override;
+
+        void PrintSelf(std::ostream &os, Indent indent) const override;
+
+    private:
+        /// Linear buffer offset of the nearest voxel with mask set for every voxel, -1 if there is none.
+        void ComputeFeatureTransform(const std::vector<unsigned char> &mask,
+                                     std::vector<OffsetValueType> &nearest) const;
+
+        /// Squared distance between the voxels at two linear buffer offsets.
+        double SquaredDistance(OffsetValueType a, OffsetValueType b) const;
+
+        bool m_Signed;
+        bool m_InsideIsPositive;
+        bool m_UseImageSpacing;
+
+        // buffer geometry of the current run.
+        typename InputImageType::SizeType m_Size;
+        OffsetValueType m_Strides[ImageDimension];
+        double m_Spacing[ImageDimension];
+    };
+
+} // end namespace itk
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSeparableDistanceMapImageFilter.hxx"
+#endif
+
+#endif //SKELTOOLS_itkSeparableDistanceMapImageFilter_h
@@ -0,0 +1,268 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+#ifndef SKELTOOLS_itkSeparableDistanceMapImageFilter_hxx
+#define SKELTOOLS_itkSeparableDistanceMapImageFilter_hxx
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <itkMultiThreaderBase.h>
+
+#include "itkSeparableDistanceMapImageFilter.h"
+
+namespace itk {
+    template<typename TInputImage, typename TOutputImage>
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::SeparableDistanceMapImageFilter() {
+        m_Signed = true;
+        m_InsideIsPositive = false;
+        m_UseImageSpacing = true;
+        m_Size.Fill(0);
+        for (unsigned d = 0; d < ImageDimension; ++d) {
+            m_Strides[d] = 0;
+            m_Spacing[d] = 1.0;
+        }
+        this->SetNumberOfRequiredOutputs(2);
+        this->SetNthOutput(1, this->MakeOutput(1));
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    typename SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::DataObjectPointer
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::MakeOutput(DataObjectPointerArraySizeType idx) {
+        if (idx == 1) {
+            return VectorImageType::New().GetPointer();
+        }
+        return Superclass::MakeOutput(idx);
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    typename SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::VectorImageType *
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::GetVectorDistanceMap() {
+        return dynamic_cast<VectorImageType *>(this->ProcessObject::GetOutput(1));
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::GenerateInputRequestedRegion() {
+        Superclass::GenerateInputRequestedRegion();
+        if (auto input = const_cast<InputImageType *>(this->GetInput())) {
+            input->SetRequestedRegionToLargestPossibleRegion();
+        }
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::EnlargeOutputRequestedRegion(DataObject *data) {
+        Superclass::EnlargeOutputRequestedRegion(data);
+        data->SetRequestedRegionToLargestPossibleRegion();
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    double
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::SquaredDistance(OffsetValueType a,
+                                                                              OffsetValueType b) const {
+        double distance = 0;
+        for (unsigned d = 0; d < ImageDimension; ++d) {
+            const auto size = static_cast<OffsetValueType>(m_Size[d]);
+            const double delta = m_Spacing[d] * static_cast<double>(a % size - b % size);
+            distance += delta * delta;
+            a /= size;
+            b /= size;
+        }
+        return distance;
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::ComputeFeatureTransform(
+            const std::vector<unsigned char> &mask, std::vector<OffsetValueType> &nearest) const {
+        const SizeValueType numberOfPixels = mask.size();
+        MultiThreaderBase *multiThreader = this->GetMultiThreader();
+
+        for (unsigned axis = 0; axis < ImageDimension; ++axis) {
+            const SizeValueType length = m_Size[axis];
+            const OffsetValueType stride = m_Strides[axis];
+            const double spacing2 = m_Spacing[axis] * m_Spacing[axis];
+            const SizeValueType numberOfLines = numberOfPixels / length;
+            // a few chunks of lines per thread balance the load.
+            const SizeValueType linesPerChunk =
+                    std::max<SizeValueType>(1, numberOfLines / (8 * multiThreader->GetNumberOfWorkUnits()));
+            const SizeValueType numberOfChunks = (numberOfLines + linesPerChunk - 1) / linesPerChunk;
+
+            multiThreader->ParallelizeArray(0, numberOfChunks, [&](SizeValueType chunk) {
+                std::vector<OffsetValueType> features(length), line(length);
+                std::vector<double> heights(length), boundaries(length + 1);
+                std::vector<SizeValueType> apexes(length);
+                const SizeValueType lastLine = std::min(numberOfLines, (chunk + 1) * linesPerChunk);
+                for (SizeValueType l = chunk * linesPerChunk; l < lastLine; ++l) {
+                    // first voxel of the line: its coordinates along the other axes.
+                    OffsetValueType first = 0;
+                    SizeValueType rest = l;
+                    for (unsigned d = 0; d < ImageDimension; ++d) {
+                        if (d == axis) continue;
+                        first += static_cast<OffsetValueType>(rest % m_Size[d]) * m_Strides[d];
+                        rest /= m_Size[d];
+                    }
+
+                    if (axis == 0) {
+                        // nearest feature on the line, from the left then from the right.
+                        OffsetValueType previous = -1;
+                        for (SizeValueType i = 0; i < length; ++i) {
+                            if (mask[first + i * stride]) previous = static_cast<OffsetValueType>(i);
+                            features[i] = previous;
+                        }
+                        OffsetValueType next = -1;
+                        for (SizeValueType i = length; i-- > 0;) {
+                            if (mask[first + i * stride]) next = static_cast<OffsetValueType>(i);
+                            const auto position = static_cast<OffsetValueType>(i);
+                            OffsetValueType closest = features[i];
+                            if (next >= 0 && (closest < 0 || next - position < position - closest)) closest = next;
+                            nearest[first + i * stride] = closest < 0 ? -1 : first + closest * stride;
+                        }
+                        continue;
+                    }
+
+                    // lower envelope of the parabolas height_i + spacing^2 (j - i)^2 of the voxels
+                    // that have a feature in the lower dimensional transform.
+                    SizeValueType count = 0;
+                    for (SizeValueType i = 0; i < length; ++i) {
+                        const OffsetValueType voxel = first + i * stride;
+                        features[i] = nearest[voxel];
+                        if (features[i] < 0) continue;
+                        heights[i] = this->SquaredDistance(voxel, features[i]);
+                        const double position = static_cast<double>(i);
+                        double boundary = -std::numeric_limits<double>::infinity();
+                        while (count > 0) {
+                            // where the parabola of i gets below that of the last apex.
+                            const double apex = static_cast<double>(apexes[count - 1]);
+                            boundary = ((heights[i] + spacing2 * position * position) -
+                                        (heights[apexes[count - 1]] + spacing2 * apex * apex)) /
+                                       (2 * spacing2 * (position - apex));
+                            if (boundary > boundaries[count - 1]) break;
+                            --count;
+                        }
+                        boundaries[count] = boundary;
+                        apexes[count++] = i;
+                    }
+                    if (count == 0) continue;
+
+                    SizeValueType k = 0;
+                    for (SizeValueType j = 0; j < length; ++j) {
+                        while (k + 1 < count && boundaries[k + 1] < static_cast<double>(j)) ++k;
+                        line[j] = features[apexes[k]];
+                    }
+                    for (SizeValueType j = 0; j < length; ++j) nearest[first + j * stride] = line[j];
+                }
+            }, nullptr);
+        }
+    }
+
+    template<typename TInputImage, typename TOutputImage>
+    void
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::GenerateData() {
+        this->AllocateOutputs();
+        const InputImageType *input = this->GetInput();
+        OutputImageType *output = this->GetOutput();
+        VectorImageType *vectors = this->GetVectorDistanceMap();
+
+        const auto &region = input->GetBufferedRegion();
+        m_Size = region.GetSize();
+        const OffsetValueType *offsetTable = input->GetOffsetTable();
+        for (unsigned d = 0; d < ImageDimension; ++d) {
+            m_Strides[d] = offsetTable[d];
+            m_Spacing[d] = m_UseImageSpacing ? input->GetSpacing()[d] : 1.0;
+        }
+        const SizeValueType numberOfPixels = region.GetNumberOfPixels();
+        if (numberOfPixels == 0) return;
+        MultiThreaderBase *multiThreader = this->GetMultiThreader();
+        const SizeValueType chunkSize = std::max<SizeValueType>(
+                4096, numberOfPixels / (8 * multiThreader->GetNumberOfWorkUnits()));
+        const SizeValueType numberOfChunks = (numberOfPixels + chunkSize - 1) / chunkSize;
+        auto forEachVoxel = [&](auto &&body) {
+            multiThreader->ParallelizeArray(0, numberOfChunks, [&](SizeValueType chunk) {
+                const SizeValueType last = std::min(numberOfPixels, (chunk + 1) * chunkSize);
+                for (SizeValueType i = chunk * chunkSize; i < last; ++i) body(static_cast<OffsetValueType>(i));
+            }, nullptr);
+        };
+
+        const typename InputImageType::PixelType *in = input->GetBufferPointer();
+        std::vector<unsigned char> features(numberOfPixels);
+        forEachVoxel([&](OffsetValueType i) {
+            features[i] = in[i] != NumericTraits<typename InputImageType::PixelType>::ZeroValue();
+        });
+        std::vector<OffsetValueType> nearest(numberOfPixels);
+        this->ComputeFeatureTransform(features, nearest);
+
+        // signed: features also get the distance to the other voxels dilated by one voxel.
+        std::vector<OffsetValueType> nearestInside;
+        if (m_Signed) {
+            std::vector<unsigned char> others(numberOfPixels);
+            forEachVoxel([&](OffsetValueType i) {
+                bool other = !features[i];
+                OffsetValueType rest = i;
+                for (unsigned d = 0; d < ImageDimension && !other; ++d) {
+                    const auto coordinate = static_cast<SizeValueType>(rest % static_cast<OffsetValueType>(m_Size[d]));
+                    rest /= static_cast<OffsetValueType>(m_Size[d]);
+                    other = (coordinate > 0 && !features[i - m_Strides[d]]) ||
+                            (coordinate + 1 < m_Size[d] && !features[i + m_Strides[d]]);
+                }
+                others[i] = other;
+            });
+            nearestInside.resize(numberOfPixels);
+            this->ComputeFeatureTransform(others, nearestInside);
+        }
+
+        OutputPixelType *distance = output->GetBufferPointer();
+        typename VectorImageType::PixelType *offsets = vectors->GetBufferPointer();
+        const double sign = m_InsideIsPositive ? -1.0 : 1.0;
+        forEachVoxel([&](OffsetValueType i) {
+            typename VectorImageType::PixelType offset;
+            offset.Fill(0);
+            if (nearest[i] < 0) {
+                distance[i] = NumericTraits<OutputPixelType>::max();
+                offsets[i] = offset;
+                return;
+            }
+            OffsetValueType a = nearest[i], b = i;
+            for (unsigned d = 0; d < ImageDimension; ++d) {
+                const auto size = static_cast<OffsetValueType>(m_Size[d]);
+                offset[d] = a % size - b % size;
+                a /= size;
+                b /= size;
+            }
+            offsets[i] = offset;
+            double value = std::sqrt(this->SquaredDistance(nearest[i], i));
+            if (m_Signed && nearestInside[i] >= 0) value -= std::sqrt(this->SquaredDistance(nearestInside[i], i));
+            distance[i] = static_cast<OutputPixelType>(sign * value);
+        });
+    }
+
+/**
+*  Print Self
+*/
+    template<typename TInputImage, typename TOutputImage>
+    void
+    SeparableDistanceMapImageFilter<TInputImage, TOutputImage>::PrintSelf(std::ostream &os, Indent indent) const {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "Signed: " << m_Signed << std::endl;
+        os << indent << "InsideIsPositive: " << m_InsideIsPositive << std::endl;
+        os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+    }
+}
+#endif //SKELTOOLS_itkSeparableDistanceMapImageFilter_hxx
@@ -29,9 +29,14 @@
 #include <itkImageRegionConstIterator.h>
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <algorithm>
 #include <vector>
-#include <random>
 #include <cmath>
+#include <type_traits>
+
+#include "sphere.h"
+#include "itkAverageOutwardFluxKernel.h"
 
 
 namespace itk
@@ -57,8 +62,6 @@ template< class TInputImage,
         using Pointer = SmartPointer<Self>;
         using ConstPointer = SmartPointer<const Self>;
 
-        static const SizeValueType SphereRadius = 1;
-
 		/** Method for creation through the object factory */
 		itkNewMacro(Self);
 
@@ -79,10 +82,63 @@ template< class TInputImage,
 
         using NormalType = itk::Vector<double, TInputImage::ImageDimension>;
         using BoundaryConditionType = itk::ZeroFluxNeumannBoundaryCondition<TInputImage>;
+
+        using DistanceImageType = itk::Image<float, TInputImage::ImageDimension>;
+        using DistancePixelType = typename DistanceImageType::PixelType;
+
+        /// Optional signed distance of the object (inside negative). When set the flux is only
+        /// evaluated where the distance is below DistanceThreshold (default 0, the object
+        /// interior) and all other voxels are set to OutsideValue, so the work scales with the
+        /// object instead of the image.
+        itkSetInputMacro(DistanceImage, DistanceImageType);
+        itkGetInputMacro(DistanceImage, DistanceImageType);
+        itkSetMacro(DistanceThreshold, double);
+        itkGetConstMacro(DistanceThreshold, double);
+        itkSetMacro(OutsideValue, TOutputPixelType);
+        itkGetConstMacro(OutsideValue, TOutputPixelType);
+
+        /// Spokes at voxels whose distance is not below SpokeDistanceThreshold are read as zero
+        /// (default: no gating, requires DistanceImage). With a closest point transform
+        /// (itk::Offset pixels) as input and -1.5 voxels this is the AOF of the zeroed float
+        /// spoke field of computeSignedDistanceSpokesPair without building that field.
+        itkSetMacro(SpokeDistanceThreshold, double);
+        itkGetConstMacro(SpokeDistanceThreshold, double);
+
+        /// The region is evaluated in cache sized tiles of TileSize^Dimension voxels. Spoke fields
+        /// other than float vectors, or gated ones, are converted to float spokes per tile (plus
+        /// the stencil halo).
+        static constexpr SizeValueType TileSize = 32;
+        static constexpr bool FloatSpokes = std::is_same_v<InputPixelType, Vector<float, TInputImage::ImageDimension>>;
+
+        /// Number of sphere samples the flux values are normalized to, so that thresholds
+        /// do not depend on NumberOfSamples.
+        static constexpr unsigned ReferenceNumberOfSamples = 60;
+
+        /// Number of deterministic (Fibonacci) directions on the unit sphere the flux is
+        /// sampled at. Fewer samples are faster, more are more accurate. Default 60.
+        virtual void SetNumberOfSamples(unsigned numberOfSamples);
+        itkGetConstMacro(NumberOfSamples, unsigned);
+
+        /// Radii (in voxels) of the spheres the flux is averaged over, default {1}. Larger or
+        /// several shells smooth the flux of noisy objects; the input is padded by the stencil.
+        virtual void SetShellRadii(const std::vector<double> &radii);
+        const std::vector<double> &GetShellRadii() const { return m_ShellRadii; }
+
+        /// Adaptive sampling, see AverageOutwardFluxKernel::SetAdaptive. Values only need to be exact
+        /// near these thresholds on the output (the anchor threshold, the -approximate cut off),
+        /// elsewhere voxels stop early with an estimate on the same side. Default empty: all samples.
+        virtual void SetAdaptiveThresholds(const std::vector<double> &thresholds);
+        const std::vector<double> &GetAdaptiveThresholds() const { return m_AdaptiveThresholds; }
+        /// Standard errors of the adaptive confidence interval, default 3.
+        itkSetMacro(AdaptiveConfidence, double);
+        itkGetConstMacro(AdaptiveConfidence, double);
 	protected:
         SpokeFieldToAverageOutwardFluxImageFilter();
         ~SpokeFieldToAverageOutwardFluxImageFilter() = default;
 
+        /// Strides of the sample offsets in the input buffer, adaptive thresholds.
+        void BeforeThreadedGenerateData() override;
+
         /// \brief Compute the AOF.
         void DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread) override;
 
@@ -93,8 +149,14 @@ template< class TInputImage,
         void PrintSelf(std::ostream& os, Indent indent) const;
 
 private:
-        void NormalsToASphere();
-        std::vector< itk::Vector<double, TInputImage::ImageDimension> > m_Points;
+        AverageOutwardFluxKernel<TInputImage::ImageDimension> m_Kernel;
+        unsigned m_NumberOfSamples;
+        std::vector<double> m_ShellRadii;
+        std::vector<double> m_AdaptiveThresholds;
+        double m_AdaptiveConfidence;
+        double m_DistanceThreshold;
+        double m_SpokeDistanceThreshold;
+        TOutputPixelType m_OutsideValue;
         BoundaryConditionType m_Accessor;
     };
 } // end namespace itk
@@ -27,7 +27,14 @@ namespace itk {
     template<class TInputImage, class TOutputPixelType>
     SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::SpokeFieldToAverageOutwardFluxImageFilter() {
         this->DynamicMultiThreadingOn();
-        this->NormalsToASphere();
+        this->AddOptionalInputName("DistanceImage");
+        m_DistanceThreshold = 0.0;
+        m_SpokeDistanceThreshold = NumericTraits<double>::max();
+        m_OutsideValue = NumericTraits<TOutputPixelType>::ZeroValue();
+        m_ShellRadii = {1.0};
+        m_AdaptiveConfidence = 3.0;
+        m_NumberOfSamples = 0;
+        this->SetNumberOfSamples(ReferenceNumberOfSamples);
     }
 
     template<class TInputImage, class TOutputPixelType>
@@ -68,11 +75,15 @@ namespace itk {
 
         // pad the input requested region by the radius of sphere used to
         // compute the flux.
-        inputRequestedRegion.PadByRadius(this->SphereRadius);
+        inputRequestedRegion.PadByRadius(m_Kernel.GetRadius());
 
         // crop the input requested region at the input's largest possible region
         if (inputRequestedRegion.Crop(inputPtr->GetLargestPossibleRegion())) {
             inputPtr->SetRequestedRegion(inputRequestedRegion);
+            // spokes can be gated by the distance at the sample voxels, it needs the same halo.
+            if (auto distancePtr = const_cast<DistanceImageType *>(this->GetDistanceImage())) {
+                distancePtr->SetRequestedRegion(inputRequestedRegion);
+            }
             return;
         } else {
             // Couldn't crop the region (requested region is outside the largest
@@ -94,50 +105,47 @@ namespace itk {
 
     template<class TInputImage, class TOutputPixelType>
     void
-    SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::NormalsToASphere() {
-        ::std::random_device rd;  //Will be used to obtain a seed for the random number engine
-        ::std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-        ::std::uniform_real_distribution<double> dis(0.0, 1.0);
-        constexpr unsigned Dimension = TInputImage::ImageDimension;
-        constexpr unsigned N = 60;
-        ::std::vector<NormalType> forces;
-        NormalType n;
-        for (size_t d = 0; d < Dimension; ++d) n[d] = 0;
-        forces.push_back(n);
-        n[0] = 1.0;
-        this->m_Points.push_back(n);
-        for (size_t count = 0; count < N - 1; ++count) {
-            for (size_t d = 0; d < Dimension; ++d) {
-                n[d] = dis(gen);
-            }
-            n.Normalize();
-            //hope that no two point are the same.
-            this->m_Points.push_back(n);
-            forces.push_back(0.0 * n);
+    SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::SetNumberOfSamples(unsigned numberOfSamples) {
+        if (numberOfSamples == 0) {
+            itkExceptionMacro("Number of sphere samples must be positive.");
         }
+        if (numberOfSamples == m_NumberOfSamples) return;
+        m_NumberOfSamples = numberOfSamples;
+        m_Kernel.SetSamples(sphere::Samples<TInputImage::ImageDimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
 
-        double r;
-        NormalType forceVector;
-        int iteration = 0;
-        do {
-            for (size_t i = 1; i < N; ++i) {
-                forces[i] *= 0.0;                        // Initialize force vector zero
-                for (size_t j = 0; j < N; ++j) {
-                    if (i == j) continue;
-                    forceVector = this->m_Points[i] - this->m_Points[j];
-                    r = forceVector.GetNorm();
-                    r *= r;
-                    forceVector /= r;
-                    forces[i] += forceVector; // Get contributing forces from other particles.
-                }
-            }
-            for (size_t i = 1; i < N; ++i) {
-                //move point on sphere.
-                this->m_Points[i] += forces[i];
-                this->m_Points[i].Normalize();
-            }
-        } while (++iteration < 50);
-        itkDebugMacro("Finished Computing normals to sphere.");
+
+    template<class TInputImage, class TOutputPixelType>
+    void
+    SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::SetShellRadii(const std::vector<double> &radii) {
+        if (radii.empty() || *std::min_element(radii.begin(), radii.end()) <= 0) {
+            itkExceptionMacro("Shell radii must be positive.");
+        }
+        if (radii == m_ShellRadii) return;
+        m_ShellRadii = radii;
+        m_Kernel.SetSamples(sphere::Samples<TInputImage::ImageDimension>(m_NumberOfSamples), m_ShellRadii);
+        this->Modified();
+    }
+
+
+    template<class TInputImage, class TOutputPixelType>
+    void
+    SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::SetAdaptiveThresholds(
+            const std::vector<double> &thresholds) {
+        if (thresholds == m_AdaptiveThresholds) return;
+        m_AdaptiveThresholds = thresholds;
+        this->Modified();
+    }
+
+
+    template<class TInputImage, class TOutputPixelType>
+    void
+    SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::BeforeThreadedGenerateData() {
+        m_Kernel.ComputeStrides(this->GetInput());
+        m_Kernel.SetAdaptive(m_AdaptiveThresholds,
+                             static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples(),
+                             m_AdaptiveConfidence);
     }
 
 
@@ -145,32 +153,75 @@ namespace itk {
     void
     SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::DynamicThreadedGenerateData(
             const OutputImageRegionType &outputRegionForThread) {
-        typename OutputImageType::Pointer output = this->GetOutput();
-        typename TInputImage::ConstPointer input = this->GetInput();
-
-        OutputIteratorType aofIt = OutputIteratorType(output, outputRegionForThread);
-
-        double f = 0;
-        typename TInputImage::IndexType currentIndex, spokeIndex, boundaryIndex;
-        for (aofIt.GoToBegin(); !aofIt.IsAtEnd(); ++aofIt) {
-            f = 0.0;
-            currentIndex = aofIt.GetIndex();
-            for (auto point: this->m_Points) {
-                //get spoke vector.
-                for (size_t d = 0; d < TInputImage::ImageDimension; ++d) {
-                    spokeIndex[d] = std::floor((static_cast<double>(currentIndex[d]) + point[d] + 0.5));
+        const TInputImage *input = this->GetInput();
+        const DistanceImageType *distance = this->GetDistanceImage();
+        const auto threshold = static_cast<DistancePixelType>(m_DistanceThreshold);
+        const double scale = static_cast<double>(ReferenceNumberOfSamples) / m_Kernel.GetNumberOfSamples();
+        const bool gated = distance != nullptr && m_SpokeDistanceThreshold < NumericTraits<double>::max();
+        const bool direct = FloatSpokes && !gated;
+
+        // The region is traversed in tiles so that the sample stencils of neighbouring lines
+        // stay in cache for larger shell radii. Unless the spokes are already ungated floats, each
+        // tile with its stencil halo is converted into a small float spoke image the kernel runs
+        // on, the kernel copy holds the strides of that tile.
+        constexpr unsigned Dimension = TInputImage::ImageDimension;
+        using TileImageType = Image<Vector<float, Dimension>, Dimension>;
+        using RegionType = typename TInputImage::RegionType;
+        const auto spokeThreshold = static_cast<DistancePixelType>(m_SpokeDistanceThreshold);
+        AverageOutwardFluxKernel<Dimension> kernel = m_Kernel;
+        ZeroFluxNeumannBoundaryCondition<TileImageType> tileAccessor;
+        auto tile = TileImageType::New();
+
+        SizeValueType numberOfTiles = 1;
+        typename TInputImage::SizeType tileGrid;
+        for (unsigned d = 0; d < Dimension; ++d) {
+            tileGrid[d] = (outputRegionForThread.GetSize(d) + TileSize - 1) / TileSize;
+            numberOfTiles *= tileGrid[d];
+        }
+        for (SizeValueType t = 0; t < numberOfTiles; ++t) {
+            RegionType block;
+            SizeValueType rest = t;
+            for (unsigned d = 0; d < Dimension; ++d) {
+                const SizeValueType start = (rest % tileGrid[d]) * TileSize;
+                rest /= tileGrid[d];
+                block.SetIndex(d, outputRegionForThread.GetIndex(d) + static_cast<IndexValueType>(start));
+                block.SetSize(d, std::min(TileSize, outputRegionForThread.GetSize(d) - start));
+            }
+            if (direct) {
+                m_Kernel.EvaluateRegion(input, distance, threshold, m_Accessor,
+                                        scale, m_OutsideValue, this->GetOutput(), block);
+                continue;
+            }
+
+            RegionType tileRegion = block;
+            tileRegion.PadByRadius(kernel.GetRadius());
+            tileRegion.Crop(input->GetBufferedRegion());
+            if (tile->GetBufferedRegion() != tileRegion) {
+                tile->SetRegions(tileRegion);
+                tile->Allocate();
+                kernel.ComputeStrides(tile.GetPointer());
+            }
+
+            ImageRegionConstIterator<TInputImage> spokeIt(input, tileRegion);
+            ImageRegionIterator<TileImageType> tileIt(tile, tileRegion);
+            typename TileImageType::PixelType value;
+            if (gated) {
+                ImageRegionConstIterator<DistanceImageType> dIt(distance, tileRegion);
+                for (; !tileIt.IsAtEnd(); ++spokeIt, ++tileIt, ++dIt) {
+                    const float multiplier = dIt.Get() < spokeThreshold ? 1 : 0;
+                    const InputPixelType &spoke = spokeIt.Get();
+                    for (unsigned d = 0; d < Dimension; ++d) value[d] = multiplier * static_cast<float>(spoke[d]);
+                    tileIt.Set(value);
                 }
-                InputPixelType spokeVector = m_Accessor.GetPixel(spokeIndex, input);
-                //Not sure how much following loop (sub-pixel shift) helps..
-                for (size_t d = 0; d < TInputImage::ImageDimension; ++d) {
-                    boundaryIndex[d] = currentIndex[d] + spokeVector[d];
-                    spokeVector[d] = boundaryIndex[d] - (static_cast<double>(currentIndex[d]) + point[d] + 0.5);
+            } else {
+                for (; !tileIt.IsAtEnd(); ++spokeIt, ++tileIt) {
+                    const InputPixelType &spoke = spokeIt.Get();
+                    for (unsigned d = 0; d < Dimension; ++d) value[d] = static_cast<float>(spoke[d]);
+                    tileIt.Set(value);
                 }
-                spokeVector.Normalize();
-                //compute dot product of normalized vectors
-                f -= (spokeVector * point);
             }
-            aofIt.Set(f);
+            kernel.EvaluateRegion(tile.GetPointer(), distance, threshold, tileAccessor,
+                                  scale, m_OutsideValue, this->GetOutput(), block);
         }
     }
 
@@ -183,6 +234,17 @@ namespace itk {
     SpokeFieldToAverageOutwardFluxImageFilter<TInputImage, TOutputPixelType>::PrintSelf(std::ostream &os, Indent indent) const {
         Superclass::PrintSelf(os, indent);
         os << indent << "SpokeFieldToAverageOutwardFluxImageFilter." << std::endl;
+        os << indent << "NumberOfSamples: " << m_NumberOfSamples << std::endl;
+        os << indent << "ShellRadii:";
+        for (double radius: m_ShellRadii) os << " " << radius;
+        os << std::endl;
+        os << indent << "AdaptiveThresholds:";
+        for (double threshold: m_AdaptiveThresholds) os << " " << threshold;
+        os << std::endl;
+        os << indent << "AdaptiveConfidence: " << m_AdaptiveConfidence << std::endl;
+        os << indent << "DistanceThreshold: " << m_DistanceThreshold << std::endl;
+        os << indent << "SpokeDistanceThreshold: " << m_SpokeDistanceThreshold << std::endl;
+        os << indent << "OutsideValue: " << m_OutsideValue << std::endl;
     }
 
 }
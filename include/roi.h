@@ -0,0 +1,54 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+
+#ifndef SKELTOOLS_ROI_H
+#define SKELTOOLS_ROI_H
+
+#include <string>
+#include <itkImage.h>
+#include <itkLogger.h>
+
+#include "itkCommandLineArgumentParser.h"
+
+/// Region of interest of -roi x0 y0 (z0) x1 y1 (z1), corners as inclusive voxel indices of fileName,
+/// clipped to the image. Returns false if -roi was not given or is unusable.
+template<typename TImage>
+bool getRegionOfInterest(const std::string &fileName,
+                         const itk::CommandLineArgumentParser::Pointer &parser,
+                         const itk::Logger::Pointer &logger,
+                         typename TImage::RegionType &roi);
+
+/// Halo (in voxels) covering a gaussian of the given variance (in voxels^2).
+inline unsigned smoothingHalo(double variance);
+
+/// Object of fileName computed on roi plus the halo needed for its distances and thinning to match
+/// those of the whole image. buildObject(readRegion) computes the object on readRegion of the file.
+/// The halo starts at initialHalo and is grown until it exceeds twice the deepest object voxel of roi
+/// (once for the distance transform, once for the boundary the crop introduces into the thinning).
+/// roiInObject receives roi in the index space of the returned image.
+template<typename TObjectImage, typename TBuildObject>
+typename TObjectImage::Pointer
+computeObjectWithHalo(const std::string &fileName, const typename TObjectImage::RegionType &roi,
+                      unsigned initialHalo, TBuildObject buildObject, const itk::Logger::Pointer &logger,
+                      typename TObjectImage::RegionType &roiInObject);
+
+#include "roi.hxx"
+#endif //SKELTOOLS_ROI_H
@@ -0,0 +1,154 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+#ifndef SKELTOOLS_ROI_HXX
+#define SKELTOOLS_ROI_HXX
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include <itkImageFileReader.h>
+#include <itkBinaryThresholdImageFilter.h>
+#include "itkSeparableDistanceMapImageFilter.h"
+#include <itkImageRegionConstIterator.h>
+
+#include "roi.h"
+
+
+template<typename TImage>
+typename TImage::RegionType readLargestPossibleRegion(const std::string &fileName){
+    auto reader = itk::ImageFileReader<TImage>::New();
+    reader->SetFileName(fileName);
+    reader->UpdateOutputInformation();
+    return reader->GetOutput()->GetLargestPossibleRegion();
+}
+
+
+template<typename TImage>
+bool getRegionOfInterest(const std::string &fileName,
+                         const itk::CommandLineArgumentParser::Pointer &parser,
+                         const itk::Logger::Pointer &logger,
+                         typename TImage::RegionType &roi){
+    constexpr unsigned Dimension = TImage::ImageDimension;
+    std::vector<long> corners;
+    if (!parser->GetCommandLineArgument("-roi", corners)) {
+        return false;
+    }
+    if (corners.size() != 2 * Dimension) {
+        logger->Warning("-roi expects " + std::to_string(2 * Dimension) + " voxel indices, ignoring it\n");
+        return false;
+    }
+
+    typename TImage::IndexType index;
+    typename TImage::SizeType size;
+    for (unsigned d = 0; d < Dimension; ++d) {
+        const long lower = std::min(corners[d], corners[d + Dimension]);
+        const long upper = std::max(corners[d], corners[d + Dimension]);
+        index[d] = lower;
+        size[d] = upper - lower + 1;
+    }
+    roi.SetIndex(index);
+    roi.SetSize(size);
+    if (!roi.Crop(readLargestPossibleRegion<TImage>(fileName))) {
+        logger->Warning("-roi lies outside of the input image, ignoring it\n");
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << "Region of interest : " << roi.GetIndex() << " size " << roi.GetSize() << "\n";
+    logger->Info(ss.str());
+    return true;
+}
+
+
+inline unsigned smoothingHalo(double variance){
+    return static_cast<unsigned>(std::ceil(3 * std::sqrt(std::max(variance, 0.0)))) + 1;
+}
+
+
+template<typename TObjectImage, typename TBuildObject>
+typename TObjectImage::Pointer
+computeObjectWithHalo(const std::string &fileName, const typename TObjectImage::RegionType &roi,
+                      unsigned initialHalo, TBuildObject buildObject, const itk::Logger::Pointer &logger,
+                      typename TObjectImage::RegionType &roiInObject){
+    constexpr unsigned Dimension = TObjectImage::ImageDimension;
+    using ObjectImageType = TObjectImage;
+    using PixelType = typename ObjectImageType::PixelType;
+    using RegionType = typename ObjectImageType::RegionType;
+    using DistanceImageType = itk::Image<float, Dimension>;
+
+    const RegionType largest = readLargestPossibleRegion<ObjectImageType>(fileName);
+    unsigned halo = initialHalo;
+    while (true) {
+        RegionType readRegion = roi;
+        readRegion.PadByRadius(halo);
+        readRegion.Crop(largest);
+        typename ObjectImageType::Pointer object = buildObject(readRegion);
+
+        roiInObject = roi;
+        for (unsigned d = 0; d < Dimension; ++d) {
+            roiInObject.SetIndex(d, roi.GetIndex(d) - readRegion.GetIndex(d));
+        }
+        if (readRegion == largest) {
+            logger->Info("Halo reaches the image border, processing the whole image\n");
+            return object;
+        }
+
+        // depth of the roi voxels. Background cut away by the crop can only make it larger.
+        using InvertFilterType = itk::BinaryThresholdImageFilter<ObjectImageType, ObjectImageType>;
+        auto invert = InvertFilterType::New();
+        invert->SetInput(object);
+        invert->SetLowerThreshold(itk::NumericTraits<PixelType>::OneValue());
+        invert->SetInsideValue(itk::NumericTraits<PixelType>::ZeroValue());
+        invert->SetOutsideValue(itk::NumericTraits<PixelType>::OneValue());
+
+        using DistanceFilterType = itk::SeparableDistanceMapImageFilter<ObjectImageType, DistanceImageType>;
+        auto distanceFilter = DistanceFilterType::New();
+        distanceFilter->SetInput(invert->GetOutput());
+        distanceFilter->SignedOff();
+        distanceFilter->SetUseImageSpacing(false);
+        distanceFilter->Update();
+
+        float maxDepth = 0;
+        itk::ImageRegionConstIterator<DistanceImageType> dit(distanceFilter->GetOutput(), roiInObject);
+        for (dit.GoToBegin(); !dit.IsAtEnd(); ++dit) {
+            maxDepth = std::max(maxDepth, dit.Get());
+        }
+
+        // without background in the crop the depth is unbounded (the float maximum), a halo of the
+        // image extent already reads the whole image.
+        unsigned maxHalo = 0;
+        for (unsigned d = 0; d < Dimension; ++d) {
+            maxHalo = std::max(maxHalo, static_cast<unsigned>(largest.GetSize(d)));
+        }
+        const double depth = std::min(static_cast<double>(maxDepth), static_cast<double>(maxHalo));
+        const unsigned required = std::min(maxHalo, initialHalo + 2 * static_cast<unsigned>(std::ceil(depth)) + 2);
+        logger->Debug("Halo " + std::to_string(halo) + " voxels, required " + std::to_string(required) + "\n");
+        if (halo >= required) {
+            logger->Info("Using a halo of " + std::to_string(halo) + " voxels around the region of interest\n");
+            return object;
+        }
+        halo = required;
+    }
+}
+
+#endif //SKELTOOLS_ROI_HXX
@@ -0,0 +1,43 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+
+#ifndef SKELTOOLS_SPHERE_H
+#define SKELTOOLS_SPHERE_H
+
+#include <vector>
+#include <itkVector.h>
+
+namespace sphere {
+    template<unsigned VDimension>
+    using SampleType = itk::Vector<double, VDimension>;
+
+    /// N deterministic, evenly spread unit vectors: equally spaced angles on the circle (2D),
+    /// golden angle (Fibonacci) spiral on the sphere (3D).
+    template<unsigned VDimension>
+    std::vector<SampleType<VDimension>> FibonacciSamples(unsigned N);
+
+    /// FibonacciSamples computed once per (dimension, N) and shared by all callers.
+    template<unsigned VDimension>
+    const std::vector<SampleType<VDimension>> &Samples(unsigned N);
+}
+
+#include "sphere.hxx"
+#endif //SKELTOOLS_SPHERE_H
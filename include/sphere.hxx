@@ -0,0 +1,69 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+#ifndef SKELTOOLS_SPHERE_HXX
+#define SKELTOOLS_SPHERE_HXX
+
+#include <cmath>
+#include <map>
+#include <mutex>
+
+#include "sphere.h"
+
+namespace sphere {
+    template<unsigned VDimension>
+    std::vector<SampleType<VDimension>> FibonacciSamples(unsigned N) {
+        static_assert(VDimension == 2 || VDimension == 3, "Sphere samples are available in 2D and 3D");
+        const double pi = std::acos(-1.0);
+        std::vector<SampleType<VDimension>> samples(N);
+        if constexpr (VDimension == 2) {
+            for (unsigned i = 0; i < N; ++i) {
+                const double angle = 2 * pi * i / N;
+                samples[i][0] = std::cos(angle);
+                samples[i][1] = std::sin(angle);
+            }
+        } else {
+            const double goldenAngle = pi * (3 - std::sqrt(5.0));
+            for (unsigned i = 0; i < N; ++i) {
+                const double z = 1 - (2 * i + 1) / static_cast<double>(N);
+                const double r = std::sqrt(1 - z * z);
+                const double angle = goldenAngle * i;
+                samples[i][0] = r * std::cos(angle);
+                samples[i][1] = r * std::sin(angle);
+                samples[i][2] = z;
+            }
+        }
+        return samples;
+    }
+
+    template<unsigned VDimension>
+    const std::vector<SampleType<VDimension>> &Samples(unsigned N) {
+        static std::map<unsigned, std::vector<SampleType<VDimension>>> cache;
+        static std::mutex cacheMutex;
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(N);
+        if (it == cache.end()) {
+            it = cache.emplace(N, FibonacciSamples<VDimension>(N)).first;
+        }
+        return it->second;
+    }
+}
+
+#endif //SKELTOOLS_SPHERE_HXX
@@ -0,0 +1,51 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+
+#ifndef SKELTOOLS_TIMESERIES_H
+#define SKELTOOLS_TIMESERIES_H
+
+#include <itkImage.h>
+#include <itkLogger.h>
+
+#include "itkCommandLineArgumentParser.h"
+
+/// Bounding box of the voxels that differ between previous and current.
+/// Returns false if the images are identical.
+template<typename TImage>
+bool computeChangedRegion(const typename TImage::Pointer &previous, const typename TImage::Pointer &current,
+                          typename TImage::RegionType &changed);
+
+/// Warm start of the signed distance (and AOF if aof is not nullptr) of object after its voxels
+/// changed inside the region changed. Both are recomputed on a crop around the change, grown until
+/// every voxel the change can influence is exact in the crop, and pasted back in place.
+/// The AOF filter is configured from parser (see configureAOFFilter).
+/// Returns the bounding box of all voxels whose object, distance or AOF value changed.
+template<typename TObjectImage, typename TDistanceImage>
+typename TObjectImage::RegionType
+updateSignedDistanceAOF(const typename TObjectImage::Pointer &object,
+                        const typename TObjectImage::RegionType &changed,
+                        const typename TDistanceImage::Pointer &signedDistance,
+                        const typename TDistanceImage::Pointer &aof,
+                        const itk::CommandLineArgumentParser::Pointer &parser,
+                        const itk::Logger::Pointer &logger);
+
+#include "timeseries.hxx"
+#endif //SKELTOOLS_TIMESERIES_H
@@ -0,0 +1,217 @@
+//**********************************************************
+//Copyright Tabish Syed
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+//
+// Created by tabish on 2026-10-18.
+//
+
+
+#ifndef SKELTOOLS_TIMESERIES_HXX
+#define SKELTOOLS_TIMESERIES_HXX
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include "flux.h"
+#include "util.h"
+#include "itkSpokeFieldToAverageOutwardFluxImageFilter.h"
+
+
+/// Euclidean (physical) distance from index to the closest voxel of region.
+template<typename TRegion, typename TSpacing>
+double physicalDistanceToRegion(const typename TRegion::IndexType &index, const TRegion &region,
+                                const TSpacing &spacing){
+    double sum = 0;
+    for (unsigned d = 0; d < TRegion::ImageDimension; ++d) {
+        const itk::IndexValueType lower = region.GetIndex(d);
+        const itk::IndexValueType upper = lower + static_cast<itk::IndexValueType>(region.GetSize(d)) - 1;
+        itk::IndexValueType gap = 0;
+        if (index[d] < lower) gap = lower - index[d];
+        else if (index[d] > upper) gap = index[d] - upper;
+        sum += (gap * spacing[d]) * (gap * spacing[d]);
+    }
+    return std::sqrt(sum);
+}
+
+/// Physical distance from index (inside region) to the closest voxel outside region.
+template<typename TRegion, typename TSpacing>
+double physicalDistanceToOutside(const typename TRegion::IndexType &index, const TRegion &region,
+                                 const TSpacing &spacing){
+    double distance = std::numeric_limits<double>::max();
+    for (unsigned d = 0; d < TRegion::ImageDimension; ++d) {
+        const itk::IndexValueType lower = region.GetIndex(d);
+        const itk::IndexValueType upper = lower + static_cast<itk::IndexValueType>(region.GetSize(d)) - 1;
+        const itk::IndexValueType steps = std::min(index[d] - lower, upper - index[d]) + 1;
+        distance = std::min(distance, steps * spacing[d]);
+    }
+    return distance;
+}
+
+
+template<typename TImage>
+bool computeChangedRegion(const typename TImage::Pointer &previous, const typename TImage::Pointer &current,
+                          typename TImage::RegionType &changed){
+    constexpr unsigned Dimension = TImage::ImageDimension;
+    using IndexType = typename TImage::IndexType;
+    const auto region = current->GetLargestPossibleRegion();
+    if (previous->GetLargestPossibleRegion() != region) {
+        changed = region;
+        return true;
+    }
+
+    itk::ImageRegionConstIteratorWithIndex<TImage> cit(current, region);
+    itk::ImageRegionConstIterator<TImage> pit(previous, region);
+    IndexType lower, upper;
+    bool found = false;
+    for (cit.GoToBegin(), pit.GoToBegin(); !cit.IsAtEnd(); ++cit, ++pit) {
+        if (cit.Get() == pit.Get()) continue;
+        const IndexType &index = cit.GetIndex();
+        if (!found) {
+            lower = upper = index;
+            found = true;
+        }
+        for (unsigned d = 0; d < Dimension; ++d) {
+            lower[d] = std::min(lower[d], index[d]);
+            upper[d] = std::max(upper[d], index[d]);
+        }
+    }
+    if (!found) return false;
+
+    typename TImage::SizeType size;
+    for (unsigned d = 0; d < Dimension; ++d) size[d] = upper[d] - lower[d] + 1;
+    changed.SetIndex(lower);
+    changed.SetSize(size);
+    return true;
+}
+
+
+template<typename TObjectImage, typename TDistanceImage>
+typename TObjectImage::RegionType
+updateSignedDistanceAOF(const typename TObjectImage::Pointer &object,
+                        const typename TObjectImage::RegionType &changed,
+                        const typename TDistanceImage::Pointer &signedDistance,
+                        const typename TDistanceImage::Pointer &aof,
+                        const itk::CommandLineArgumentParser::Pointer &parser,
+                        const itk::Logger::Pointer &logger){
+    constexpr unsigned Dimension = TObjectImage::ImageDimension;
+    using ObjectImageType = TObjectImage;
+    using DistanceImageType = TDistanceImage;
+    using RegionType = typename ObjectImageType::RegionType;
+    using IndexType = typename ObjectImageType::IndexType;
+
+    const RegionType largest = object->GetLargestPossibleRegion();
+    const auto spacing = object->GetSpacing();
+    const double minSpacing = *std::min_element(spacing.Begin(), spacing.End());
+    const double maxSpacing = *std::max_element(spacing.Begin(), spacing.End());
+    // spokes are zeroed 1.5 voxels from the boundary and the AOF reads the spokes up to the
+    // largest shell radius (rounded) around.
+    const auto radii = getAOFShellRadii(parser, logger);
+    const double slack = (2 + *std::max_element(radii.begin(), radii.end())) * maxSpacing;
+
+    // Only voxels inside the object (negative distance) matter. The distance of a voxel can only
+    // change if it is closer to the changed box than its distance, so the previous maximal depth
+    // is a good first guess for the margin.
+    double maxDepth = 0;
+    itk::ImageRegionConstIterator<DistanceImageType> dit(signedDistance, largest);
+    for (dit.GoToBegin(); !dit.IsAtEnd(); ++dit) {
+        maxDepth = std::max(maxDepth, -static_cast<double>(dit.Get()));
+    }
+    auto margin = static_cast<itk::SizeValueType>(std::ceil((maxDepth + slack) / minSpacing)) + 1;
+
+    IndexType lower = changed.GetIndex();
+    IndexType upper = changed.GetUpperIndex();
+    while (true) {
+        RegionType crop = changed;
+        crop.PadByRadius(margin);
+        crop.Crop(largest);
+        const bool whole = (crop == largest);
+        logger->Debug("Recomputing distance on crop of " + std::to_string(crop.GetNumberOfPixels()) + " voxels\n");
+
+        auto cropObject = extractRegion<ObjectImageType>(object, crop);
+        typename DistanceImageType::Pointer cropDistance, cropAOF;
+        if (aof != nullptr) {
+            auto distanceAOF =
+                    computeObjectSignedDistanceAOFPair<ObjectImageType, DistanceImageType>(cropObject, parser, logger);
+            cropDistance = distanceAOF.first;
+            cropAOF = distanceAOF.second;
+        } else {
+            cropDistance = computeObjectSignedDistanceSpokesPair<ObjectImageType, DistanceImageType>(
+                    cropObject, logger).first;
+        }
+
+        // Voxels outside the crop do not exist for its distance transform, so distances near the
+        // crop border differ from the global map. Inside voxels within reach of the change must
+        // still be exact (closest background and stencil inside the crop).
+        bool complete = true;
+        itk::ImageRegionConstIteratorWithIndex<DistanceImageType> pit(signedDistance, crop);
+        itk::ImageRegionConstIterator<DistanceImageType> cit(cropDistance, cropDistance->GetLargestPossibleRegion());
+        for (pit.GoToBegin(), cit.GoToBegin(); !whole && !pit.IsAtEnd(); ++pit, ++cit) {
+            const double depth = -static_cast<double>(cit.Get());
+            if (depth <= 0) continue;
+            const IndexType index = pit.GetIndex();
+            const double reach = std::max(depth, -static_cast<double>(pit.Get())) + slack;
+            if (depth + slack > physicalDistanceToOutside(index, crop, spacing)
+                && physicalDistanceToRegion(index, changed, spacing) <= reach) {
+                complete = false;
+                break;
+            }
+        }
+        if (!complete) {
+            margin *= 2;
+            logger->Debug("Change influence exceeds crop, growing margin to " + std::to_string(margin) + "\n");
+            continue;
+        }
+
+        itk::ImageRegionIteratorWithIndex<DistanceImageType> wit(signedDistance, crop);
+        for (wit.GoToBegin(), cit.GoToBegin(); !wit.IsAtEnd(); ++wit, ++cit) {
+            const double depth = -static_cast<double>(cit.Get());
+            const IndexType index = wit.GetIndex();
+            // inside voxels near the crop border keep their (exact) global values.
+            if (depth > 0 && !whole && depth + slack > physicalDistanceToOutside(index, crop, spacing)) continue;
+            // outside voxels are not thinned and only their sign is exact; those that keep it
+            // do not count as changed, or the crop border would spread the box over the crop.
+            const bool inside = depth > 0 || wit.Get() < 0;
+            if (inside && wit.Get() != cit.Get()) {
+                for (unsigned d = 0; d < Dimension; ++d) {
+                    lower[d] = std::min(lower[d], index[d]);
+                    upper[d] = std::max(upper[d], index[d]);
+                }
+            }
+            wit.Set(cit.Get());
+            if (aof != nullptr) {
+                IndexType cropIndex;
+                for (unsigned d = 0; d < Dimension; ++d) cropIndex[d] = index[d] - crop.GetIndex(d);
+                aof->SetPixel(index, cropAOF->GetPixel(cropIndex));
+            }
+        }
+        break;
+    }
+
+    // AOF reads spokes one voxel around.
+    typename ObjectImageType::SizeType size;
+    for (unsigned d = 0; d < Dimension; ++d) size[d] = upper[d] - lower[d] + 1;
+    RegionType influence(lower, size);
+    influence.PadByRadius(1);
+    influence.Crop(largest);
+    return influence;
+}
+#endif //SKELTOOLS_TIMESERIES_HXX
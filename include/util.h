@@ -25,6 +25,8 @@
 #include <itkImage.h>
 #include <itkLogger.h>
 
+#include "itkCommandLineArgumentParser.h"
+
 template<typename TImage>
 void writeImage(const std::string & filePath, const typename TImage::Pointer &image,
                 const itk::Logger::Pointer &logger);
@@ -33,6 +35,33 @@ template<typename TImage>
 typename TImage::Pointer readImage(const std::string & filePath,
                                    const itk::Logger::Pointer &logger);
 
+/// Nearest neighbour resampling to voxels factor times larger (factor > 1 shrinks)
+/// covering the same physical extent.
+template<typename TImage>
+typename TImage::Pointer resampleByFactor(const typename TImage::Pointer &image, double factor,
+                                          const itk::Logger::Pointer &logger);
+
+/// Nearest neighbour resampling onto the voxel grid of reference.
+template<typename TImage, typename TReferenceImage>
+typename TImage::Pointer resampleLike(const typename TImage::Pointer &image,
+                                      const typename TReferenceImage::Pointer &reference,
+                                      const itk::Logger::Pointer &logger);
+
+/// Sub image over region (index space of image) keeping its physical placement.
+template<typename TImage>
+typename TImage::Pointer extractRegion(const typename TImage::Pointer &image,
+                                       const typename TImage::RegionType &region);
+
+/// Copy sourceRegion of source into image, starting at destinationIndex.
+template<typename TImage>
+void pasteRegion(const typename TImage::Pointer &image, const typename TImage::Pointer &source,
+                 const typename TImage::RegionType &sourceRegion,
+                 const typename TImage::IndexType &destinationIndex);
+
+/// Downsampling factor requested by -preview F, 1 if no (valid) preview was asked for.
+inline double getPreviewFactor(const itk::CommandLineArgumentParser::Pointer &parser,
+                               const itk::Logger::Pointer &logger);
+
 #include "util.hxx"
 
 #endif //SKELTOOLS_UTIL_H
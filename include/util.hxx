@@ -26,10 +26,20 @@
 #include <itkImageFileWriter.h>
 #include <itkImageFileReader.h>
 #include <itkExtractImageFilter.h>
+#include <itkResampleImageFilter.h>
+#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkContinuousIndex.h>
+#include <itkRegionOfInterestImageFilter.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include <type_traits>
 #include <concepts>
 
 #include "config.h"
+#include "itkCommandLineArgumentParser.h"
 
 
 template<typename T> requires std::integral<T>
@@ -125,4 +135,97 @@ typename TImage::Pointer readImage(const std::string & filePath,
     return reader->GetOutput();
 }
 
+template<typename TImage>
+typename TImage::Pointer resampleByFactor(const typename TImage::Pointer &image, double factor,
+                                          const itk::Logger::Pointer &logger) {
+    constexpr unsigned Dimension = TImage::ImageDimension;
+    using ResampleFilterType = itk::ResampleImageFilter<TImage, TImage>;
+    using InterpolatorType = itk::NearestNeighborInterpolateImageFunction<TImage, double>;
+
+    auto region = image->GetLargestPossibleRegion();
+    typename TImage::SizeType size;
+    typename TImage::SpacingType spacing;
+    itk::ContinuousIndex<double, Dimension> firstCenter;
+    for (unsigned d = 0; d < Dimension; ++d) {
+        size[d] = std::max<itk::SizeValueType>(1, std::ceil(region.GetSize(d) / factor));
+        spacing[d] = image->GetSpacing()[d] * factor;
+        // center of the first output voxel, in input voxel units.
+        firstCenter[d] = region.GetIndex(d) + 0.5 * (factor - 1);
+    }
+    typename TImage::PointType origin;
+    image->TransformContinuousIndexToPhysicalPoint(firstCenter, origin);
+
+    auto resampler = ResampleFilterType::New();
+    resampler->SetInput(image);
+    resampler->SetInterpolator(InterpolatorType::New());
+    resampler->SetSize(size);
+    resampler->SetOutputSpacing(spacing);
+    resampler->SetOutputOrigin(origin);
+    resampler->SetOutputDirection(image->GetDirection());
+    resampler->SetDefaultPixelValue(0);
+    resampler->Update();
+
+    std::stringstream ss;
+    ss << "Resampled image by factor " << factor << " to size " << size << "\n";
+    logger->Debug(ss.str());
+    return resampler->GetOutput();
+}
+
+template<typename TImage, typename TReferenceImage>
+typename TImage::Pointer resampleLike(const typename TImage::Pointer &image,
+                                      const typename TReferenceImage::Pointer &reference,
+                                      const itk::Logger::Pointer &logger) {
+    using ResampleFilterType = itk::ResampleImageFilter<TImage, TImage>;
+    using InterpolatorType = itk::NearestNeighborInterpolateImageFunction<TImage, double>;
+    auto resampler = ResampleFilterType::New();
+    resampler->SetInput(image);
+    resampler->SetInterpolator(InterpolatorType::New());
+    resampler->SetReferenceImage(reference);
+    resampler->UseReferenceImageOn();
+    resampler->SetDefaultPixelValue(0);
+    resampler->Update();
+    logger->Debug("Resampled image onto reference grid\n");
+    return resampler->GetOutput();
+}
+
+template<typename TImage>
+typename TImage::Pointer extractRegion(const typename TImage::Pointer &image,
+                                       const typename TImage::RegionType &region) {
+    using ExtractFilterType = itk::RegionOfInterestImageFilter<TImage, TImage>;
+    auto extractFilter = ExtractFilterType::New();
+    extractFilter->SetInput(image);
+    extractFilter->SetRegionOfInterest(region);
+    extractFilter->Update();
+    return extractFilter->GetOutput();
+}
+
+template<typename TImage>
+void pasteRegion(const typename TImage::Pointer &image, const typename TImage::Pointer &source,
+                 const typename TImage::RegionType &sourceRegion,
+                 const typename TImage::IndexType &destinationIndex) {
+    typename TImage::RegionType destinationRegion(destinationIndex, sourceRegion.GetSize());
+    itk::ImageRegionConstIterator<TImage> sit(source, sourceRegion);
+    itk::ImageRegionIterator<TImage> dit(image, destinationRegion);
+    for (sit.GoToBegin(), dit.GoToBegin(); !sit.IsAtEnd(); ++sit, ++dit) {
+        dit.Set(sit.Get());
+    }
+}
+
+inline double getPreviewFactor(const itk::CommandLineArgumentParser::Pointer &parser,
+                               const itk::Logger::Pointer &logger) {
+    double factor = 1;
+    if (!parser->GetCommandLineArgument("-preview", factor)) {
+        return 1;
+    }
+    if (factor <= 1) {
+        logger->Warning("Ignoring preview factor " + std::to_string(factor) + " <= 1\n");
+        return 1;
+    }
+    std::stringstream ss;
+    ss << "Preview: running at 1/" << factor << " of the input resolution"
+       << " and upsampling the result to input geometry\n";
+    logger->Write(itk::LoggerBaseEnums::PriorityLevel::MUSTFLUSH, ss.str());
+    return factor;
+}
+
 #endif //SKELTOOLS_UTILS_HXX
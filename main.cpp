@@ -51,6 +51,12 @@ std::string helpstring() {
     ss << "\t -output\n";
     ss << "\t\t path to output file\n";
 
+    ss << "\t -preview F\n";
+    ss << "\t\t quick look: run the selected module on the object downsampled by F, output at input geometry\n";
+
+    ss << "\t -roi x0 y0 z0 x1 y1 z1\n";
+    ss << "\t\t (skeletonize, homotopic, aof) only read and process the voxel box between the corners plus a halo, output the box\n";
+
     ss << "\t -h, --help\n";
     ss << "\t\t display this help\n";
 
@@ -66,6 +72,9 @@ std::string helpstring() {
     ss << "===========================================\n";
 
 	ss << "\t\t -threshold T      ::(default 1)(object threshold for binary object)\n";
+	ss << "\t\t -engine E         ::(default heap) 3D thinning order: heap (float chamfer heap), bucket (integer chamfer bucket queue)\n"
+	      "\t\t                      or directional (parallel layer by layer directional subiterations)\n";
+	ss << "\t\t -depths d1 d2 ..  ::(3D) also write <output>_removalDistance (iteration of removal) and the result after d iterations <output>_depth<d>\n";
 
     //------------------------------------------------------------------------
     ss << "AOF Options:: \n";
@@ -73,6 +82,10 @@ std::string helpstring() {
 
     ss << "\t\t Algorithms:\n";
     ss << "\t\t\t -approximate [T]    :: Medial Surface by thresholding (@optional T {0.4}) AOF values\n";
+    ss << "\t\t\t -tiled [N]          :: AOF of the spoke field -input (e.g. _CPT.mha of -writeIntermediate) written to -output in\n"
+          "\t\t\t                        slabs of N {32} slices with bounded memory, -distance F restricts it to the object\n";
+    ss << "\t\t -slabs N              :: (default 32) -approximate streams AOF and threshold in slabs of N slices, bounding\n"
+          "\t\t                          the AOF memory (the full AOF is computed only for -writeIntermediate)\n";
     ss << "\t\t -useprecomputed       :: Use precomputed intermediate images for distance transform, AOF\n";
     ss << "\t\t -writeIntermediate    :: Write intermediate distance transform, spoke field, AOF images\n";
     ss << "\t\t -spacing x y..        :: size of image voxel\n";
@@ -84,15 +97,32 @@ std::string helpstring() {
     //------------------------------------------------------------------------
     ss << "Priority Options:: \n";
     ss << "===========================================\n";
-    ss << "\t\t -curve / -surface     :: medial curve/surface algorithm\n";
-    ss << "\t\t -fillholes            :: fill object holes before skeletonization\n";
+    ss << "\t\t -curve / -surface     :: medial curve/surface algorithm (default surface, curve with -weighted)\n";
+    ss << "\t\t -timeseries           :: -input f0 f1 .. are frames, re-thin only where the object changed (<output>_tNNNNN)\n";
+    ss << "\t\t -changeMargin M       :: (default 2) voxels re-thinned around the changed region of a frame\n";
+    ss << "\t\t -cascade              :: medial surface and the medial curve thinned from it (<output>_surface, <output>_curve)\n";
+    ss << "\t\t -fillholes            :: fill object holes before skeletonization (distance and AOF of the filled object)\n";
     ss << "\t\t -weighted             :: radius weighted skeleton\n";
+    ss << "\t\t -batchties            :: pop equal priority voxels together, in memory order with prefetched neighbourhoods\n";
+    ss << "\t\t -pyramid F            :: coarse to fine, restrict ordered thinning to a band around the skeleton of the object downsampled by F\n";
+    ss << "\t\t -band R               :: (default ceil(F)) pyramid band radius in voxels\n";
     ss << "\t\t -spacing x y..        :: size of image voxel\n";
     ss << "\t\t -smooth V             :: (default 1 px) Variance of gaussian used for smoothing input image\n";
     ss << "\t\t -lthreshold           :: Lower threshold for generating binary object\n";
     ss << "\t\t -uthreshold           :: Upper threshold for generating binary object\n";
     ss << "\t\t -anchor [aof,""]      :: (optional, default none)use anchored end points\n";
 	ss << "\t\t -threshold T          :: (optional default -30(-10) for medial curve(surface)) threshold value for aof anchor \n";
+	ss << "\t\t -curveThreshold T     :: (optional default -30) aof anchor threshold of the -cascade medial curve\n";
+	ss << "\t\t -writeAnchorMap       :: (aof anchor) also write <output>_<surface|curve>ApproximateAnchorThreshold, {value < T} approximates the skeleton at T <= -threshold,\n"
+	      "\t\t                          and <output>_<surface|curve>RemovalRank, at processing resolution\n";
+	ss << "\t\t -samples N            :: (default 60) deterministic sphere directions per AOF voxel, fewer is faster (values stay on the 60 sample scale)\n";
+	ss << "\t\t -shells r1 r2 ..      :: (default 1) AOF averaged over spheres of these radii in voxels, larger for noisy objects\n";
+	ss << "\t\t -divergence           :: fast AOF approximation from the divergence of the normalized distance gradient (-approximate, -anchor aof)\n";
+	ss << "\t\t -adaptive [Z]         :: stop AOF sampling once a voxel is (Z {3} standard errors) clearly on one side of the\n"
+	      "\t\t                          -approximate cut off or the anchor thresholds, exact AOF only near them\n";
+	ss << "\t\t -lazyaof              :: (-anchor aof) evaluate the AOF from the closest point transform only where the anchor test reads it,\n"
+	      "\t\t                          no full volume AOF pass; quick mode is not applied (skeleton as with -slow),\n"
+	      "\t\t                          saves compute, not memory: the closest point transform is kept for the whole run\n";
     //------------------------------------------------------------------------
 
     ss << "\n\n";
@@ -17,30 +17,45 @@
 // Created by tabish on 2023-06-30.
 //
 
+#include <cmath>
+
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkImageIOBase.h>
 #include <itkDiscreteGaussianImageFilter.h>
 #include <itkBinaryFillholeImageFilter.h>
+#include <itkRegionOfInterestImageFilter.h>
 
 #include "config.h"
+#include "util.h"
+#include "roi.h"
 #include "homotopic.h"
 #include "itkHomotopicThinningImageFilter.h"
 
-template <typename InputPixelType, unsigned int Dimension>
-int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
-                    const itk::Logger::Pointer &logger) {
-
-    logger->Info("Running Homotopic Thinning\n");
-    std::string inputFileName;
-	parser->GetCommandLineArgument("-input", inputFileName);
-
-    using InputImageType = itk::Image<InputPixelType,Dimension>;
-
+/// Object of readRegion of fileName (all of it if empty): optionally (-smooth) smoothed,
+/// thresholded and (-fillholes) hole filled.
+template <typename InputImageType>
+static typename InputImageType::Pointer
+buildHomotopicObject(const std::string &inputFileName,
+                     const typename InputImageType::RegionType &readRegion,
+                     const itk::CommandLineArgumentParser::Pointer &parser,
+                     const itk::Logger::Pointer &logger) {
+    using InputPixelType = typename InputImageType::PixelType;
+    constexpr unsigned Dimension = InputImageType::ImageDimension;
     using ReaderType = itk::ImageFileReader<InputImageType>;
     auto reader = ReaderType::New();
     reader->SetFileName(inputFileName);
 
+    // only the requested part of the file is read when the image IO supports streaming.
+    using RegionOfInterestFilterType = itk::RegionOfInterestImageFilter<InputImageType, InputImageType>;
+    auto regionOfInterestFilter = RegionOfInterestFilterType::New();
+    typename InputImageType::Pointer sourceImage = reader->GetOutput();
+    if (readRegion.GetNumberOfPixels() > 0) {
+        regionOfInterestFilter->SetInput(reader->GetOutput());
+        regionOfInterestFilter->SetRegionOfInterest(readRegion);
+        sourceImage = regionOfInterestFilter->GetOutput();
+    }
+
     typename InputImageType::Pointer inputImage;
 
     double smoothingVariance;
@@ -52,7 +67,7 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
         using FloatImageType = itk::Image<float,Dimension>;
         using GaussianFilterType = itk::DiscreteGaussianImageFilter<InputImageType , FloatImageType >;
         typename GaussianFilterType::Pointer smoothingFilter = GaussianFilterType::New();
-        smoothingFilter->SetInput(reader->GetOutput());
+        smoothingFilter->SetInput(sourceImage);
         std::vector<float> varVector(Dimension,smoothingVariance);
         std::stringstream ss;
         ss << "Set smoothing variance to : (";
@@ -90,7 +105,6 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
         inputImage = thresholdFilter->GetOutput();
     }else{
         logger->Debug("Using default object without smoothing\n ");
-        reader->Update();
         using ThresholdFilterType = itk::BinaryThresholdImageFilter< InputImageType , InputImageType>;
         typename ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
 
@@ -114,7 +128,7 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
 
         thresholdFilter->SetOutsideValue(objectOutsideValue);
         thresholdFilter->SetInsideValue(objectInsideValue);
-        thresholdFilter->SetInput(reader->GetOutput());
+        thresholdFilter->SetInput(sourceImage);
         thresholdFilter->Update();
         inputImage = thresholdFilter->GetOutput();
     }
@@ -132,6 +146,42 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
         logger->Debug("Using object without hole filling\n");
         objectImage = inputImage;
     }
+    return objectImage;
+}
+
+
+template <typename InputPixelType, unsigned int Dimension>
+int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
+                    const itk::Logger::Pointer &logger) {
+
+    logger->Info("Running Homotopic Thinning\n");
+    std::string inputFileName;
+	parser->GetCommandLineArgument("-input", inputFileName);
+
+    using InputImageType = itk::Image<InputPixelType,Dimension>;
+
+    // -roi: only the region of interest plus a halo is read, the skeleton is cropped back to it.
+    using RegionType = typename InputImageType::RegionType;
+    RegionType roi, outputRegion;
+    typename InputImageType::Pointer objectImage;
+    bool hasROI = getRegionOfInterest<InputImageType>(inputFileName, parser, logger, roi);
+    if(hasROI){
+        double smoothingVariance = 0;
+        parser->GetCommandLineArgument("-smooth", smoothingVariance);
+        auto buildObject = [&](const RegionType &readRegion) {
+            return buildHomotopicObject<InputImageType>(inputFileName, readRegion, parser, logger);
+        };
+        objectImage = computeObjectWithHalo<InputImageType>(inputFileName, roi, smoothingHalo(smoothingVariance),
+                                                            buildObject, logger, outputRegion);
+    }else{
+        objectImage = buildHomotopicObject<InputImageType>(inputFileName, RegionType(), parser, logger);
+    }
+
+    typename InputImageType::Pointer inputObjectImage = objectImage;
+    double previewFactor = getPreviewFactor(parser, logger);
+    if(previewFactor > 1){
+        objectImage = resampleByFactor<InputImageType>(objectImage, previewFactor, logger);
+    }
 
     using HomotopicThinningFilter = itk::HomotopicThinningImageFilter<InputPixelType,Dimension>;
     auto thinningFilter = HomotopicThinningFilter::New();
@@ -145,12 +195,50 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
 	}
     thinningFilter->SetLowerThreshold(static_cast<InputPixelType>(objectThreshold));
 
+    std::string engine = "heap";
+    parser->GetCommandLineArgument("-engine", engine);
+    if constexpr (Dimension == 3) {
+        using EngineType = typename HomotopicThinningFilter::EngineType;
+        if (engine == "bucket") {
+            thinningFilter->SetEngine(EngineType::BucketQueue);
+        } else if (engine == "directional") {
+            thinningFilter->SetEngine(EngineType::Directional);
+        } else if (engine != "heap") {
+            logger->Warning("Unknown thinning engine " + engine + ", using heap\n");
+            engine = "heap";
+        }
+    } else if (engine != "heap") {
+        logger->Warning("Thinning engine " + engine + " is only available in 3D, using heap\n");
+        engine = "heap";
+    }
+    logger->Info("Using " + engine + " thinning engine\n");
+
+    // -depths: thinning results at several depths from this one run, by thresholding removal depths.
+    std::vector<float> depths;
+    if constexpr (Dimension == 3) {
+        if (parser->GetCommandLineArgument("-depths", depths)) {
+            thinningFilter->SetComputeRemovalDistance(true);
+        }
+    } else if (parser->ArgumentExists("-depths")) {
+        logger->Warning("-depths is only available in 3D, ignoring it\n");
+    }
+
 
 	using OutputImageType = InputImageType;
 
+    typename OutputImageType::Pointer skeleton = thinningFilter->GetOutput();
+    if(previewFactor > 1){
+        thinningFilter->Update();
+        skeleton = resampleLike<OutputImageType, InputImageType>(skeleton, inputObjectImage, logger);
+    }
+    if(hasROI){
+        thinningFilter->Update();
+        skeleton = extractRegion<OutputImageType>(skeleton, outputRegion);
+    }
+
     using WriterType = itk::ImageFileWriter<OutputImageType>;
     auto writer = WriterType::New();
-    writer->SetInput(thinningFilter->GetOutput());
+    writer->SetInput(skeleton);
 
 	std::string outputFileName;
 	parser->GetCommandLineArgument("-output", outputFileName);
@@ -166,6 +254,41 @@ int homotopic_impl(const itk::CommandLineArgumentParser::Pointer &parser,
 		return EXIT_FAILURE;
 	}
 
+    if constexpr (Dimension == 3) {
+        if (!depths.empty()) {
+            using DistanceImageType = typename HomotopicThinningFilter::InternalImageType;
+            typename DistanceImageType::Pointer removalDistance = thinningFilter->GetRemovalDistanceImage();
+            if(previewFactor > 1){
+                removalDistance = resampleLike<DistanceImageType, InputImageType>(removalDistance, inputObjectImage,
+                                                                                 logger);
+            }
+            if(hasROI){
+                removalDistance = extractRegion<DistanceImageType>(removalDistance, outputRegion);
+            }
+            fs::path outputFilePath(outputFileName);
+            auto siblingPath = [&outputFilePath](const std::string &suffix) {
+                return (outputFilePath.parent_path() / (outputFilePath.stem().string() + suffix +
+                                                        outputFilePath.extension().string())).string();
+            };
+            writeImage<DistanceImageType>(siblingPath("_removalDistance"), removalDistance, logger);
+
+            using DepthThresholdFilterType = itk::BinaryThresholdImageFilter<DistanceImageType, OutputImageType>;
+            for (float depth: depths) {
+                auto depthFilter = DepthThresholdFilterType::New();
+                depthFilter->SetInput(removalDistance);
+                // removal iterations are integers, a result at depth d keeps those above d.
+                depthFilter->SetLowerThreshold(std::max(std::floor(depth) + 1, 1.0f));
+                depthFilter->SetUpperThreshold(std::numeric_limits<float>::infinity());
+                depthFilter->SetInsideValue(itk::NumericTraits<InputPixelType>::OneValue());
+                depthFilter->SetOutsideValue(itk::NumericTraits<InputPixelType>::ZeroValue());
+                depthFilter->Update();
+                std::stringstream ss;
+                ss << "_depth" << depth;
+                writeImage<OutputImageType>(siblingPath(ss.str()), depthFilter->GetOutput(), logger);
+            }
+        }
+    }
+
     return EXIT_SUCCESS;
 }
 
@@ -23,12 +23,65 @@
 #include "config.h"
 #include "flux.h"
 #include "util.h"
+#include "roi.h"
 
 #include <itkImage.h>
 #include <itkLogger.h>
 #include <itkImageIOBase.h>
 #include <itkImageIOFactory.h>
 #include <itkBinaryThresholdImageFilter.h>
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkStreamingImageFilter.h>
+
+/// Approximate medial surface {AOF < cutOff} of spokes, restricted to the object by distance (if
+/// given) whose spokes are gated at spokeDistanceThreshold. The AOF filter and the threshold are
+/// driven by a StreamingImageFilter in slabs of slabSize slices, so the AOF is only held per slab.
+template<typename TSpokeImage, typename TObjectImage, typename TDistanceImage>
+typename TObjectImage::Pointer
+streamApproximateMedialSurface(const TSpokeImage *spokes, const TDistanceImage *distance,
+                               double spokeDistanceThreshold, double cutOff, unsigned slabSize,
+                               const itk::CommandLineArgumentParser::Pointer &parser,
+                               const itk::Logger::Pointer &logger){
+    constexpr unsigned Dimension = TObjectImage::ImageDimension;
+    using FluxValueType = typename TDistanceImage::PixelType;
+    using FluxImageType = itk::Image<FluxValueType, Dimension>;
+
+    using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter<TSpokeImage, FluxValueType>;
+    typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
+    configureAOFFilter(aofFilter.GetPointer(), parser, logger);
+    aofFilter->SetInput(spokes);
+    if (distance) {
+        aofFilter->SetDistanceImage(distance);
+        aofFilter->SetSpokeDistanceThreshold(spokeDistanceThreshold);
+    }
+
+    using ThresholdFilterType = itk::BinaryThresholdImageFilter<FluxImageType, TObjectImage>;
+    typename ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
+    thresholdFilter->SetLowerThreshold(cutOff);
+    thresholdFilter->SetUpperThreshold(std::numeric_limits<FluxValueType>::max());
+    thresholdFilter->SetOutsideValue(1);
+    thresholdFilter->SetInsideValue(0);
+    thresholdFilter->SetInput(aofFilter->GetOutput());
+
+    using StreamerType = itk::StreamingImageFilter<TObjectImage, TObjectImage>;
+    typename StreamerType::Pointer streamer = StreamerType::New();
+    streamer->SetInput(thresholdFilter->GetOutput());
+    try {
+        thresholdFilter->UpdateOutputInformation();
+        auto size = thresholdFilter->GetOutput()->GetLargestPossibleRegion().GetSize();
+        unsigned numberOfSlabs = (size[Dimension - 1] + slabSize - 1) / slabSize;
+        streamer->SetNumberOfStreamDivisions(numberOfSlabs);
+        logger->Info("Streaming AOF and threshold in " + std::to_string(numberOfSlabs) + " slabs of " +
+                     std::to_string(slabSize) + " slices\n");
+        streamer->Update();
+    } catch (itk::ExceptionObject &e) {
+        logger->Critical("Failed computing the approximate medial surface\n");
+        logger->Critical(std::string(e.what()) + "\n");
+        return nullptr;
+    }
+    return streamer->GetOutput();
+}
 
 template<typename InputPixelType, unsigned Dimension>
 int approximateMedialSurface_impl(const itk::CommandLineArgumentParser::Pointer &parser,
@@ -40,6 +93,8 @@ int approximateMedialSurface_impl(const itk::CommandLineArgumentParser::Pointer
 
     using FluxValueType = DistanceValueType;
     using FluxImageType = itk::Image<FluxValueType, Dimension>;
+    using ClosestPointImageType = typename itk::SeparableDistanceMapImageFilter<ObjectImageType,
+            DistanceImageType>::VectorImageType;
 
     logger->Info("Starting AOF Approximate Medial Surface computation\n");
     std::string inputFileName;
@@ -57,80 +112,167 @@ int approximateMedialSurface_impl(const itk::CommandLineArgumentParser::Pointer
     logger->Debug("Set spoke field file path to : " + spokeFilePath.string() + "\n");
 
     typename DistanceImageType::Pointer distanceMap;
+    using SpokeReaderType = itk::ImageFileReader<SpokeFieldImageType>;
+    typename SpokeReaderType::Pointer spokeReader;
     typename SpokeFieldImageType::Pointer spokeField;
+    typename ClosestPointImageType::Pointer closestPoints;
+    double spokeDistanceThreshold = itk::NumericTraits<double>::max();
+    typename FluxImageType::Pointer aof;
+
+    // intermediate images of a preview or a region of interest do not match the input geometry.
+    double previewFactor = getPreviewFactor(parser, logger);
+    typename ObjectImageType::RegionType roi, outputRegion;
+    bool hasROI = getRegionOfInterest<ObjectImageType>(inputFileName, parser, logger, roi);
+    bool usePrecomputed = parser->ArgumentExists("-useprecomputed") && previewFactor <= 1 && !hasROI;
+    bool writeIntermediate = parser->ArgumentExists("-writeIntermediate") && previewFactor <= 1 && !hasROI;
+    typename ObjectImageType::Pointer inputObjectImage;
 
     if((!fs::exists(distanceMapFilePath) || !fs::exists(spokeFilePath))
-       && parser->ArgumentExists("-useprecomputed")){
+       && usePrecomputed){
         logger->Warning("distance map/spoke file does not exist!"
                         " Ignoring -useprecomputed argument\n");
     }
 
     if (fs::exists(distanceMapFilePath)
         && fs::exists(spokeFilePath)
-        && parser->ArgumentExists("-useprecomputed") ) {
+        && usePrecomputed ) {
 
         logger->Info("Reading precomputed distance map and spoke field\n");
         //distanceMap = readImage<DistanceImageType>(distanceMapFilePath.string(), logger);
-        spokeField = readImage<SpokeFieldImageType>(spokeFilePath.string(), logger);
+        // not updated here, the streamed AOF reads it slab by slab where the file format allows.
+        spokeReader = SpokeReaderType::New();
+        spokeReader->SetFileName(spokeFilePath.string());
+        spokeField = spokeReader->GetOutput();
     }else{
         logger->Info("Computing distance map and Spoke field\n");
-        auto distClosestPointPair =
-                computeObjectSignedDistanceSpokesPair<ObjectImageType, DistanceImageType>(parser, logger);
-        distanceMap = distClosestPointPair.first;
-        if(parser->ArgumentExists("-writeIntermediate")){
-            writeImage<DistanceImageType>(distanceMapFilePath, distanceMap, logger);
+        typename ObjectImageType::Pointer objectImage;
+        if(previewFactor > 1 || hasROI){
+            if(hasROI){
+                double smoothingVariance = 1;
+                parser->GetCommandLineArgument("-smooth", smoothingVariance);
+                std::vector<float> objectSpacing(Dimension, 1);
+                parser->GetCommandLineArgument("-spacing", objectSpacing);
+                float maxSpacing = *std::max_element(objectSpacing.begin(), objectSpacing.end());
+                auto buildObject = [&](const typename ObjectImageType::RegionType &readRegion) {
+                    return computeObjectImage<ObjectImageType, DistanceImageType>(inputFileName, readRegion,
+                                                                                  parser, logger);
+                };
+                inputObjectImage = computeObjectWithHalo<ObjectImageType>(inputFileName, roi,
+                                                                          smoothingHalo(smoothingVariance * maxSpacing),
+                                                                          buildObject, logger, outputRegion);
+            }else{
+                inputObjectImage = computeObjectImage<ObjectImageType, DistanceImageType>(parser, logger);
+            }
+            objectImage = inputObjectImage;
+            if(previewFactor > 1){
+                objectImage = resampleByFactor<ObjectImageType>(inputObjectImage, previewFactor, logger);
+            }
+        }else {
+            objectImage = computeObjectImage<ObjectImageType, DistanceImageType>(parser, logger);
+        }
+        if(objectImage == nullptr){
+            return EXIT_FAILURE;
         }
-        spokeField = distClosestPointPair.second;
-        if(parser->ArgumentExists("-writeIntermediate")) {
+        // the spoke field is only materialised to be written, otherwise the AOF is streamed
+        // directly from the closest point transform.
+        if(writeIntermediate) {
+            auto distClosestPointPair =
+                    computeObjectSignedDistanceSpokesPair<ObjectImageType, DistanceImageType>(objectImage, logger);
+            distanceMap = distClosestPointPair.first;
+            writeImage<DistanceImageType>(distanceMapFilePath, distanceMap, logger);
+            spokeField = distClosestPointPair.second;
             writeImage<SpokeFieldImageType>(spokeFilePath, spokeField, logger);
+        }else if(parser->ArgumentExists("-divergence")){
+            auto distanceAOFPair =
+                    computeObjectSignedDistanceAOFPair<ObjectImageType, DistanceImageType>(objectImage, parser, logger);
+            distanceMap = distanceAOFPair.first;
+            aof = distanceAOFPair.second;
+        }else{
+            auto distanceMapFilter = computeObjectSignedDistanceMap<ObjectImageType, DistanceImageType>(objectImage);
+            distanceMap = distanceMapFilter->GetOutput();
+            closestPoints = distanceMapFilter->GetVectorDistanceMap();
+            // spokes 1.5 voxels from the boundary are zeroed as in computeObjectSignedDistanceAOFPair.
+            auto spacing = objectImage->GetSpacing();
+            spokeDistanceThreshold = -1.5 * *std::max_element(spacing.Begin(), spacing.End());
         }
     }
     fs::path aofFilePath = outputFolderPath / (inputFilePath.stem().string() + "_aof.tif");
     logger->Debug("Set AOF file path to : " + aofFilePath.string() + "\n");
 
-    typename FluxImageType::Pointer aof;
-
     if (!fs::exists(aofFilePath)
-        && parser->ArgumentExists("-useprecomputed")){
+        && usePrecomputed){
         logger->Warning("AOF file does not exist! Will ignore -useprecomputed\n");
     }
 
-    if (fs::exists(aofFilePath)
-        && parser->ArgumentExists("-useprecomputed")) {
+    // (Number of samples * 2)/pi = 40
+    // threshold value = 0.4
+	double aofThresholdValue = 0.4;
+	if(parser->GetCommandLineArgument("-approximate", aofThresholdValue)){
+		logger->Info("Set AOF Threshold value to "+ std::to_string(aofThresholdValue) +"\n");
+	}else{
+		logger->Debug("Using default AOF Threshold : " + std::to_string(aofThresholdValue) + "\n");
+	}
+    unsigned slabSize = 32;
+    parser->GetCommandLineArgument("-slabs", slabSize);
+    slabSize = std::max(slabSize, 1u);
+
+    typename ObjectImageType::Pointer skeleton;
+    if (aof != nullptr) {
+        logger->Debug("AOF computed with the distance map\n");
+    }else if (fs::exists(aofFilePath)
+        && usePrecomputed) {
         logger->Info("Reading already computed m_AOF map..\n");
         aof = readImage<FluxImageType >(aofFilePath,logger);
+    }else if (parser->ArgumentExists("-divergence") && distanceMap) {
+        aof = computeDivergenceAOF<DistanceImageType>(distanceMap, logger);
+        if(writeIntermediate) {
+            writeImage<FluxImageType>(aofFilePath.string(), aof, logger);
+        }
+    }else if (!writeIntermediate) {
+        // the AOF of the whole volume is never held, only the skeleton.
+        logger->Info("Starting streamed AOF computation and thresholding\n");
+        if (closestPoints) {
+            skeleton = streamApproximateMedialSurface<ClosestPointImageType, ObjectImageType>(
+                    closestPoints.GetPointer(), distanceMap.GetPointer(), spokeDistanceThreshold,
+                    -40 * aofThresholdValue, slabSize, parser, logger);
+        } else {
+            skeleton = streamApproximateMedialSurface<SpokeFieldImageType, ObjectImageType>(
+                    spokeField.GetPointer(), distanceMap.GetPointer(), spokeDistanceThreshold,
+                    -40 * aofThresholdValue, slabSize, parser, logger);
+        }
+        if (skeleton == nullptr) {
+            return EXIT_FAILURE;
+        }
     }else {
         logger->Info("Starting AOF computation using Spoke Vector Field\n");
         using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter< SpokeFieldImageType, FluxValueType >;
         typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
+        configureAOFFilter(aofFilter.GetPointer(), parser, logger);
         aofFilter->SetInput(spokeField);
+        if(distanceMap) {
+            aofFilter->SetDistanceImage(distanceMap);
+        }
         aofFilter->Update();
         aof = aofFilter->GetOutput();
-        if(parser->ArgumentExists("-writeIntermediate")) {
+        if(writeIntermediate) {
             writeImage<FluxImageType>(aofFilePath.string(), aof, logger);
         }
     }
 
     // TODO: move this to a separate function and switch medial algorithms here instead.
     // Only thresholding required for approximate surface.
-    using ThresholdFilterType = itk::BinaryThresholdImageFilter< FluxImageType , ObjectImageType >;
-    typename ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
-
-    // (Number of samples * 2)/pi = 40
-    // threshold value = 0.4
-	double aofThresholdValue = 0.4;
-	if(parser->GetCommandLineArgument("-approximate", aofThresholdValue)){
-		logger->Info("Set AOF Threshold value to "+ std::to_string(aofThresholdValue) +"\n");
-	}else{
-		logger->Debug("Using default AOF Threshold : " + std::to_string(aofThresholdValue) + "\n");
-	}
-    thresholdFilter->SetLowerThreshold(-40*aofThresholdValue);
-    thresholdFilter->SetUpperThreshold(std::numeric_limits<FluxValueType>::max());
-    thresholdFilter->SetOutsideValue(1);
-    thresholdFilter->SetInsideValue(0);
-    thresholdFilter->SetInput(aof);
-
-    thresholdFilter->Update();
+    if (skeleton == nullptr) {
+        using ThresholdFilterType = itk::BinaryThresholdImageFilter< FluxImageType , ObjectImageType >;
+        typename ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
+        thresholdFilter->SetLowerThreshold(-40*aofThresholdValue);
+        thresholdFilter->SetUpperThreshold(std::numeric_limits<FluxValueType>::max());
+        thresholdFilter->SetOutsideValue(1);
+        thresholdFilter->SetInsideValue(0);
+        thresholdFilter->SetInput(aof);
+
+        thresholdFilter->Update();
+        skeleton = thresholdFilter->GetOutput();
+    }
 
     std::string outputFileName;
     fs::path skeletonFilePath;
@@ -141,11 +283,98 @@ int approximateMedialSurface_impl(const itk::CommandLineArgumentParser::Pointer
         skeletonFilePath = outputFolderPath / (inputFilePath.stem().string() + "_approximateMedialSkeleotn.tif");
         logger->Debug("Using default skeleton path : " + skeletonFilePath.string() + "\n");
     }
-    writeImage<ObjectImageType>(skeletonFilePath, thresholdFilter->GetOutput(), logger);
+    if(previewFactor > 1){
+        skeleton = resampleLike<ObjectImageType, ObjectImageType>(skeleton, inputObjectImage, logger);
+    }
+    if(hasROI){
+        skeleton = extractRegion<ObjectImageType>(skeleton, outputRegion);
+    }
+    writeImage<ObjectImageType>(skeletonFilePath, skeleton, logger);
 
     return EXIT_SUCCESS;
 }
 
+/// AOF of a spoke field file (-input, e.g. the _CPT written by -writeIntermediate) written
+/// to -output slab by slab (-tiled N slices), so memory is bounded by the slab size: each slab
+/// plus the stencil halo of spokes (and -distance) is read, its AOF computed by the threaded AOF
+/// filter and written before the next one. Needs file formats ITK streams (mha, nrrd), others
+/// are read or written whole.
+template<unsigned Dimension>
+int tiledAverageOutwardFlux_impl(const itk::CommandLineArgumentParser::Pointer &parser,
+                                 const itk::Logger::Pointer &logger){
+    using FluxValueType = float;
+    using SpokeFieldImageType = itk::Image<itk::Vector<FluxValueType, Dimension>, Dimension>;
+    using DistanceImageType = itk::Image<FluxValueType, Dimension>;
+    using FluxImageType = itk::Image<FluxValueType, Dimension>;
+
+    std::string inputFileName, outputFileName, outputFolderName, distanceFileName;
+    parser->GetCommandLineArgument("-input", inputFileName);
+    parser->GetCommandLineArgument("-outputFolder", outputFolderName);
+    fs::path inputFilePath(inputFileName);
+    fs::path aofFilePath = fs::path(outputFolderName) / (inputFilePath.stem().string() + "_aof" +
+                                                         inputFilePath.extension().string());
+    if (parser->GetCommandLineArgument("-output", outputFileName)) {
+        aofFilePath = outputFileName;
+    }
+
+    unsigned slabSize = 32;
+    parser->GetCommandLineArgument("-tiled", slabSize);
+    slabSize = std::max(slabSize, 1u);
+
+    using SpokeReaderType = itk::ImageFileReader<SpokeFieldImageType>;
+    typename SpokeReaderType::Pointer spokeReader = SpokeReaderType::New();
+    spokeReader->SetFileName(inputFileName);
+    using DistanceReaderType = itk::ImageFileReader<DistanceImageType>;
+    typename DistanceReaderType::Pointer distanceReader = nullptr;
+
+    using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter<SpokeFieldImageType, FluxValueType>;
+    typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
+    configureAOFFilter(aofFilter.GetPointer(), parser, logger);
+    aofFilter->SetInput(spokeReader->GetOutput());
+    if (parser->GetCommandLineArgument("-distance", distanceFileName)) {
+        distanceReader = DistanceReaderType::New();
+        distanceReader->SetFileName(distanceFileName);
+        aofFilter->SetDistanceImage(distanceReader->GetOutput());
+    }
+
+    using WriterType = itk::ImageFileWriter<FluxImageType>;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(aofFilePath.string());
+    writer->SetInput(aofFilter->GetOutput());
+    try {
+        spokeReader->UpdateOutputInformation();
+        if (distanceReader) distanceReader->UpdateOutputInformation();
+    } catch (itk::ExceptionObject &e) {
+        logger->Critical("Failed reading " + inputFileName + "\n");
+        logger->Critical(std::string(e.what()) + "\n");
+        return EXIT_FAILURE;
+    }
+    if (!spokeReader->GetImageIO()->CanStreamRead() ||
+        (distanceReader && !distanceReader->GetImageIO()->CanStreamRead())) {
+        logger->Warning("Input format cannot be read in slabs, it is read whole\n");
+    }
+    itk::ImageIOBase::Pointer writerIO =
+            itk::ImageIOFactory::CreateImageIO(aofFilePath.string().c_str(), itk::CommonEnums::IOFileMode::WriteMode);
+    if (writerIO && !writerIO->CanStreamWrite()) {
+        logger->Warning("Output format cannot be written in slabs, the AOF is held whole\n");
+    }
+
+    auto size = spokeReader->GetOutput()->GetLargestPossibleRegion().GetSize();
+    unsigned numberOfSlabs = (size[Dimension - 1] + slabSize - 1) / slabSize;
+    writer->SetNumberOfStreamDivisions(numberOfSlabs);
+    logger->Info("Computing AOF of " + inputFileName + " in " + std::to_string(numberOfSlabs) +
+                 " slabs of " + std::to_string(slabSize) + " slices\n");
+    try {
+        writer->Update();
+        logger->Info("Wrote AOF " + aofFilePath.string() + "\n");
+    } catch (itk::ExceptionObject &e) {
+        logger->Critical("Failed writing " + aofFilePath.string() + "\n");
+        logger->Critical(std::string(e.what()) + "\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 int medial(const itk::CommandLineArgumentParser::Pointer &parser,
            const itk::Logger::Pointer &logger) {
 
@@ -231,7 +460,17 @@ int medial(const itk::CommandLineArgumentParser::Pointer &parser,
 
     // Switch algorithms
 
-    if(parser->ArgumentExists("-approximate")) {
+    if(parser->ArgumentExists("-tiled")) {
+        logger->Info("Running tiled AOF computation of a spoke field\n");
+        switch (dimensions) {
+            case 2:
+                return tiledAverageOutwardFlux_impl<2>(parser, logger);
+            case 3:
+                return tiledAverageOutwardFlux_impl<3>(parser, logger);
+            default:
+                logger->Critical("File not supported..\n");
+        }
+    }else if(parser->ArgumentExists("-approximate")) {
         logger->Info("Running Approximate Medial Surface computation\n");
         switch (dimensions) {
             case 2:
@@ -270,7 +509,8 @@ int medial(const itk::CommandLineArgumentParser::Pointer &parser,
     }else{
         logger->Warning("Unknown Medial computation algorithm\n");
         logger->Info("Available Algorithms include: \n"
-                     " \t-approximate\n");
+                     " \t-approximate\n"
+                     " \t-tiled\n");
     }
     return EXIT_FAILURE;
 }
@@ -27,61 +27,163 @@
 #include <itkDiscreteGaussianImageFilter.h>
 #include <itkChangeInformationImageFilter.h>
 #include <itkMultiplyImageFilter.h>
+#include <itkBinaryThresholdImageFilter.h>
+#include <itkBinaryDilateImageFilter.h>
+#include <itkBinaryBallStructuringElement.h>
 
 #include "util.h"
 #include "flux.h"
 #include "config.h"
 #include "experiment.h"
+#include "timeseries.h"
+#include "roi.h"
 #include "itkMedialCurveImageFilter.h"
 #include "itkAOFAnchoredMedialCurveImageFilter.h"
 #include "itkMedialSurfaceImageFilter.h"
 #include "itkAOFAnchoredMedialSurfaceImageFilter.h"
 #include "itkSpokeFieldToAverageOutwardFluxImageFilter.h"
 
+template<typename ObjectImageType>
+using BandImage = itk::Image<unsigned char, ObjectImageType::ImageDimension>;
+
+/// Distance, priority and AOF images of the object being skeletonized. Filled in by the
+/// first skeletonization and reused by the next one on the same object (-cascade).
+template<unsigned int Dimension>
+struct SharedFields {
+    using FieldImagePointerType = typename itk::Image<float, Dimension>::Pointer;
+    FieldImagePointerType distance = nullptr;
+    FieldImagePointerType priority = nullptr;
+    FieldImagePointerType aof = nullptr;
+    /// AOF evaluated on demand instead of aof (-lazyaof), memoised values are shared as well.
+    typename itk::LazyAverageOutwardFlux<Dimension>::Pointer lazyAOF = nullptr;
+    /// voxels thinning must keep (-timeseries shell), optional.
+    typename itk::Image<unsigned char, Dimension>::Pointer protectedVoxels = nullptr;
+};
+
+
+/// Options common to all ordered thinning filters.
+template<typename FilterType, typename BandImagePointerType, typename FieldsType>
+static void
+configureOrderedThinning(FilterType *filter, BandImagePointerType band, const FieldsType &fields,
+                         itk::CommandLineArgumentParser::Pointer parser,
+                         itk::Logger::Pointer logger){
+    if(parser->ArgumentExists("-weighted")){
+        filter->SetRadiusWeightedSkeleton(true);
+    }else{
+        filter->SetRadiusWeightedSkeleton(false);
+    }
+    if(parser->ArgumentExists("-batchties")){
+        filter->SetBatchTies(true);
+        logger->Info("Processing equal priority voxels in batches\n");
+    }
+    filter->SetBandImage(band);
+    filter->SetProtectedImage(fields.protectedVoxels);
+    filter->SetDistanceImage(fields.distance);
+    if(fields.priority != nullptr){
+        filter->SetPriorityImage(fields.priority);
+    }
+}
 
-template<typename ObjectImageType, typename OutputImageType>
+
+/// -writeAnchorMap: request the approximate anchor threshold and removal rank maps of an AOF anchored filter.
+template<typename FilterType>
 static void
-computeAOFAnchoredMedialCurve(typename ObjectImageType::Pointer objectImage,
-                   itk::CommandLineArgumentParser::Pointer parser,
-                   itk::Logger::Pointer logger){
-    logger->Debug("Starting AOF computation for Anchored medial curve\n");
-    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
-    using DistanceImageType = itk::Image<float, Dimension>;
-    using SpokeFieldImageType = typename itk::Image<itk::Vector < float, Dimension>, Dimension > ;
+requestAnchorMaps(FilterType *filter, itk::CommandLineArgumentParser::Pointer parser){
+    if(parser->ArgumentExists("-writeAnchorMap")){
+        filter->SetComputeApproximateAnchorThreshold(true);
+        filter->SetComputeRemovalRank(true);
+    }
+}
 
-    auto distClosestPointPair =
-            computeObjectSignedDistanceSpokesPair<ObjectImageType, DistanceImageType>(parser, logger);
-    auto spokeField = distClosestPointPair.second;
 
-    using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter<SpokeFieldImageType, float>;
-    typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
-    aofFilter->SetInput(spokeField);
-    aofFilter->Update();
+/// Write the maps of requestAnchorMaps to <output>_<name>ApproximateAnchorThreshold and <output>_<name>RemovalRank.
+template<typename FilterType>
+static void
+writeAnchorMaps(FilterType *filter, const std::string &name,
+                itk::CommandLineArgumentParser::Pointer parser,
+                itk::Logger::Pointer logger){
+    if(!parser->ArgumentExists("-writeAnchorMap")) return;
+    std::string outputFileName;
+    parser->GetCommandLineArgument("-output", outputFileName);
+    fs::path outputFilePath(outputFileName);
+    fs::path thresholdFilePath = outputFilePath.parent_path() / (outputFilePath.stem().string() + "_" + name +
+                                                                  "ApproximateAnchorThreshold" +
+                                                                  outputFilePath.extension().string());
+    fs::path rankFilePath = outputFilePath.parent_path() / (outputFilePath.stem().string() + "_" + name +
+                                                             "RemovalRank" + outputFilePath.extension().string());
+    writeImage<typename FilterType::AOFImageType>(thresholdFilePath.string(), filter->GetApproximateAnchorThresholdImage(),
+                                                  logger);
+    writeImage<typename FilterType::RankImageType>(rankFilePath.string(), filter->GetRemovalRankImage(), logger);
+}
 
-    using MedialCurveFilterType = itk::AOFAnchoredMedialCurveImageFilter<ObjectImageType, OutputImageType>;
-    typename MedialCurveFilterType::Pointer medialCurveFilter = MedialCurveFilterType::New();
-    medialCurveFilter->SetInput(objectImage);
 
-    medialCurveFilter->SetAOFImage(aofFilter->GetOutput());
+/// AOF (or with -lazyaof the lazy AOF) and (inside positive) priority from the signed distance of the object.
+/// The fields are computed from the object being thinned (hole filled with -fillholes, resampled,
+/// cropped) rather than from a re-read of the input: filled holes would otherwise keep their
+/// boundary in the AOF and anchor spurious skeleton voxels around them, and fields of a
+/// re-read input do not share the grid of a resampled or cropped object.
+template<typename ObjectImageType>
+static void
+computeAOFFields(typename ObjectImageType::Pointer objectImage,
+                 SharedFields<ObjectImageType::ImageDimension> &fields,
+                 itk::CommandLineArgumentParser::Pointer parser,
+                 itk::Logger::Pointer logger){
+    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
+    using DistanceImageType = itk::Image<float, Dimension>;
+
+    typename DistanceImageType::Pointer distance;
+    if (parser->ArgumentExists("-lazyaof") && !parser->ArgumentExists("-divergence")) {
+        auto distanceAOFPair = computeObjectSignedDistanceLazyAOFPair<ObjectImageType, DistanceImageType>(
+                objectImage, parser, logger);
+        distance = distanceAOFPair.first;
+        fields.lazyAOF = distanceAOFPair.second;
+    } else {
+        auto distanceAOFPair =
+                computeObjectSignedDistanceAOFPair<ObjectImageType, DistanceImageType>(objectImage, parser, logger);
+        distance = distanceAOFPair.first;
+        fields.aof = distanceAOFPair.second;
+    }
 
     std::string priorityType;
     parser->GetCommandLineArgument("-priority", priorityType);
-    if (priorityType == "distance") {
+    if (priorityType == "distance" && fields.priority == nullptr) {
         using ScaleFilterType = itk::MultiplyImageFilter<DistanceImageType, DistanceImageType, DistanceImageType>;
         auto inverter = ScaleFilterType::New();
-        inverter->SetInput(distClosestPointPair.first);
+        inverter->SetInput(distance);
         inverter->SetConstant(-1);
         inverter->Update();
-        medialCurveFilter->SetPriorityImage(inverter->GetOutput());//distClosestPointPair.first);
+        fields.priority = inverter->GetOutput();
     }
-    if(parser->ArgumentExists("-weighted")){
-        medialCurveFilter->SetRadiusWeightedSkeleton(true);
+}
+
+
+template<typename ObjectImageType, typename OutputImageType>
+static typename OutputImageType::Pointer
+computeAOFAnchoredMedialCurve(typename ObjectImageType::Pointer objectImage,
+                   typename BandImage<ObjectImageType>::Pointer band,
+                   SharedFields<ObjectImageType::ImageDimension> &fields,
+                   itk::CommandLineArgumentParser::Pointer parser,
+                   itk::Logger::Pointer logger,
+                   const std::string &thresholdKey = "-threshold"){
+    if(fields.aof == nullptr && fields.lazyAOF == nullptr) {
+        logger->Debug("Starting AOF computation for Anchored medial curve\n");
+        computeAOFFields<ObjectImageType>(objectImage, fields, parser, logger);
     }else{
-        medialCurveFilter->SetRadiusWeightedSkeleton(false);
+        logger->Debug("Reusing AOF for Anchored medial curve\n");
     }
 
+    using MedialCurveFilterType = itk::AOFAnchoredMedialCurveImageFilter<ObjectImageType, OutputImageType>;
+    typename MedialCurveFilterType::Pointer medialCurveFilter = MedialCurveFilterType::New();
+    medialCurveFilter->SetInput(objectImage);
+    if (fields.aof != nullptr) {
+        medialCurveFilter->SetAOFImage(fields.aof);
+    } else {
+        medialCurveFilter->SetLazyAOF(fields.lazyAOF);
+    }
+    configureOrderedThinning(medialCurveFilter.GetPointer(), band, fields, parser, logger);
+
     float threshold = -30;
-    if(parser->GetCommandLineArgument("-threshold",threshold)){
+    if(parser->GetCommandLineArgument(thresholdKey,threshold)){
         logger->Info("Set End point threshold = " + std::to_string(threshold) + "\n");
     }else{
         logger->Debug("Set End point threshold to default " + std::to_string(threshold) + "\n");
@@ -96,85 +198,59 @@ computeAOFAnchoredMedialCurve(typename ObjectImageType::Pointer objectImage,
 		medialCurveFilter->SetQuick(false);
 		logger->Debug("Using default mode: initializing with all interior points");
 	}
+    requestAnchorMaps(medialCurveFilter.GetPointer(), parser);
     medialCurveFilter->Update();
-    auto medialCurve = medialCurveFilter->GetOutput();
-
-    std::string outputFileName;
-    parser->GetCommandLineArgument("-output", outputFileName);
-
-    writeImage<OutputImageType>(outputFileName, medialCurve, logger);
+    if (fields.lazyAOF != nullptr) {
+        logger->Debug("Lazy AOF evaluated at " + std::to_string(fields.lazyAOF->GetNumberOfEvaluations()) + " voxels in " +
+                      std::to_string(fields.lazyAOF->GetNumberOfMemoBlocks()) + " memo blocks\n");
+    }
+    writeAnchorMaps(medialCurveFilter.GetPointer(), "curve", parser, logger);
+    fields.distance = medialCurveFilter->GetDistanceImage();
+    return medialCurveFilter->GetOutput();
 }
 
 
 template<typename ObjectImageType, typename OutputImageType>
-static void
+static typename OutputImageType::Pointer
 computeMedialCurve(typename ObjectImageType::Pointer objectImage,
+                   typename BandImage<ObjectImageType>::Pointer band,
+                   SharedFields<ObjectImageType::ImageDimension> &fields,
                    itk::CommandLineArgumentParser::Pointer parser,
                    itk::Logger::Pointer logger){
     using MedialCurveFilterType = itk::MedialCurveImageFilter<ObjectImageType, OutputImageType>;
     typename MedialCurveFilterType::Pointer medialCurveFilter = MedialCurveFilterType::New();
     medialCurveFilter->SetInput(objectImage);
-
-    std::string priorityType;
-    parser->GetCommandLineArgument("-priority", priorityType);
-    if (priorityType == "distance") {
-        medialCurveFilter->SetPriorityImage(nullptr);
-    }
-    if(parser->ArgumentExists("-weighted")){
-        medialCurveFilter->SetRadiusWeightedSkeleton(true);
-    }else{
-        medialCurveFilter->SetRadiusWeightedSkeleton(false);
-    }
+    configureOrderedThinning(medialCurveFilter.GetPointer(), band, fields, parser, logger);
     medialCurveFilter->Update();
-    auto medialCurve = medialCurveFilter->GetOutput();
-
-    std::string outputFileName;
-    parser->GetCommandLineArgument("-output", outputFileName);
-
-    writeImage<OutputImageType>(outputFileName, medialCurve, logger);
+    fields.distance = medialCurveFilter->GetDistanceImage();
+    fields.priority = medialCurveFilter->GetPriorityImage();
+    return medialCurveFilter->GetOutput();
 }
 
 
 template<typename ObjectImageType, typename OutputImageType>
-static void
+static typename OutputImageType::Pointer
 computeAOFAnchoredMedialSurface(typename ObjectImageType::Pointer objectImage,
+                   typename BandImage<ObjectImageType>::Pointer band,
+                   SharedFields<ObjectImageType::ImageDimension> &fields,
                    itk::CommandLineArgumentParser::Pointer parser,
                    itk::Logger::Pointer logger){
-    logger->Debug("Starting AOF computation for anchored medial surface\n");
-    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
-    using DistanceImageType = itk::Image<float, Dimension>;
-    using SpokeFieldImageType = typename itk::Image<itk::Vector < float, Dimension>, Dimension > ;
-
-    auto distClosestPointPair =
-            computeObjectSignedDistanceSpokesPair<ObjectImageType, DistanceImageType>(parser, logger);
-    auto spokeField = distClosestPointPair.second;
-
-    using AOFFilterType = itk::SpokeFieldToAverageOutwardFluxImageFilter<SpokeFieldImageType, float>;
-    typename AOFFilterType::Pointer aofFilter = AOFFilterType::New();
-    aofFilter->SetInput(spokeField);
-    aofFilter->Update();
+    if(fields.aof == nullptr && fields.lazyAOF == nullptr) {
+        logger->Debug("Starting AOF computation for anchored medial surface\n");
+        computeAOFFields<ObjectImageType>(objectImage, fields, parser, logger);
+    }else{
+        logger->Debug("Reusing AOF for anchored medial surface\n");
+    }
 
     using MedialSurfaceFilterType = itk::AOFAnchoredMedialSurfaceImageFilter<ObjectImageType, OutputImageType>;
     typename MedialSurfaceFilterType::Pointer medialSurfaceFilter = MedialSurfaceFilterType::New();
     medialSurfaceFilter->SetInput(objectImage);
-
-    medialSurfaceFilter->SetAOFImage(aofFilter->GetOutput());
-
-    std::string priorityType;
-    parser->GetCommandLineArgument("-priority", priorityType);
-    if (priorityType == "distance") {
-        using ScaleFilterType = itk::MultiplyImageFilter<DistanceImageType, DistanceImageType, DistanceImageType>;
-        auto inverter = ScaleFilterType::New();
-        inverter->SetInput(distClosestPointPair.first);
-        inverter->SetConstant(-1);
-        inverter->Update();
-        medialSurfaceFilter->SetPriorityImage(inverter->GetOutput());//distClosestPointPair.first);
-    }
-    if(parser->ArgumentExists("-weighted")){
-        medialSurfaceFilter->SetRadiusWeightedSkeleton(true);
-    }else{
-        medialSurfaceFilter->SetRadiusWeightedSkeleton(false);
+    if (fields.aof != nullptr) {
+        medialSurfaceFilter->SetAOFImage(fields.aof);
+    } else {
+        medialSurfaceFilter->SetLazyAOF(fields.lazyAOF);
     }
+    configureOrderedThinning(medialSurfaceFilter.GetPointer(), band, fields, parser, logger);
 
     float threshold = -10;
     if(parser->GetCommandLineArgument("-threshold",threshold)){
@@ -192,192 +268,427 @@ computeAOFAnchoredMedialSurface(typename ObjectImageType::Pointer objectImage,
 		medialSurfaceFilter->SetQuick(true);
 		logger->Debug("Using default quick mode: discarding all non-negative AOF point in initialization\n");
 	}
+    requestAnchorMaps(medialSurfaceFilter.GetPointer(), parser);
     medialSurfaceFilter->Update();
-    auto medialSurface = medialSurfaceFilter->GetOutput();
-
-    std::string outputFileName;
-    parser->GetCommandLineArgument("-output", outputFileName);
-
-    writeImage<OutputImageType>(outputFileName, medialSurface, logger);
+    if (fields.lazyAOF != nullptr) {
+        logger->Debug("Lazy AOF evaluated at " + std::to_string(fields.lazyAOF->GetNumberOfEvaluations()) + " voxels in " +
+                      std::to_string(fields.lazyAOF->GetNumberOfMemoBlocks()) + " memo blocks\n");
+    }
+    writeAnchorMaps(medialSurfaceFilter.GetPointer(), "surface", parser, logger);
+    fields.distance = medialSurfaceFilter->GetDistanceImage();
+    return medialSurfaceFilter->GetOutput();
 }
 
 
 template<typename ObjectImageType, typename OutputImageType>
-static void
+static typename OutputImageType::Pointer
 computeMedialSurface(typename ObjectImageType::Pointer objectImage,
+                   typename BandImage<ObjectImageType>::Pointer band,
+                   SharedFields<ObjectImageType::ImageDimension> &fields,
                    itk::CommandLineArgumentParser::Pointer parser,
                    itk::Logger::Pointer logger){
     using MedialSurfaceFilterType = itk::MedialSurfaceImageFilter<ObjectImageType, OutputImageType>;
     typename MedialSurfaceFilterType::Pointer medialSurfaceFilter = MedialSurfaceFilterType::New();
     medialSurfaceFilter->SetInput(objectImage);
-
-    std::string priorityType;
-    parser->GetCommandLineArgument("-priority", priorityType);
-    if (priorityType == "distance") {
-        medialSurfaceFilter->SetPriorityImage(nullptr);
-    }
-    if(parser->ArgumentExists("-weighted")){
-        medialSurfaceFilter->SetRadiusWeightedSkeleton(true);
-    }else{
-        medialSurfaceFilter->SetRadiusWeightedSkeleton(false);
-    }
+    configureOrderedThinning(medialSurfaceFilter.GetPointer(), band, fields, parser, logger);
     medialSurfaceFilter->Update();
-    auto medialSurface = medialSurfaceFilter->GetOutput();
+    fields.distance = medialSurfaceFilter->GetDistanceImage();
+    fields.priority = medialSurfaceFilter->GetPriorityImage();
+    return medialSurfaceFilter->GetOutput();
+}
 
-    std::string outputFileName;
-    parser->GetCommandLineArgument("-output", outputFileName);
 
-    writeImage<OutputImageType>(outputFileName, medialSurface, logger);
+/// -curve and -surface select the skeleton they name. Without either, unweighted
+/// skeletons are medial surfaces and radius weighted ones medial curves.
+static bool
+isMedialSurfaceRequested(const itk::CommandLineArgumentParser::Pointer &parser){
+    if (!parser->ArgumentExists("-weighted")) {
+        return !parser->ArgumentExists("-curve");
+    }
+    return parser->ArgumentExists("-surface");
 }
 
 
-template <typename InputPixelType, unsigned int Dimension>
-int skeletonize_impl(const itk::CommandLineArgumentParser::Pointer &parser,
-                    const itk::Logger::Pointer &logger) {
-
-    logger->Info("Skeltoniation module\n");
-    std::string inputFileName;
-    parser->GetCommandLineArgument("-input", inputFileName);
+/// Skeleton selected by -anchor, -curve/-surface and -weighted (via OutputImageType).
+template<typename ObjectImageType, typename OutputImageType>
+static typename OutputImageType::Pointer
+computeSkeleton(typename ObjectImageType::Pointer objectImage,
+                typename BandImage<ObjectImageType>::Pointer band,
+                SharedFields<ObjectImageType::ImageDimension> &fields,
+                itk::CommandLineArgumentParser::Pointer parser,
+                itk::Logger::Pointer logger){
+    std::string weighting = parser->ArgumentExists("-weighted") ? "radius weighted" : "unweighted";
+    std::string anchorType;
+    parser->GetCommandLineArgument("-anchor", anchorType);
+    if (anchorType == "aof") {
+        if (isMedialSurfaceRequested(parser)) {
+            logger->Info("Running " + weighting + " AOF Anchored medial surface\n");
+            return computeAOFAnchoredMedialSurface<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+        }
+        logger->Info("Running " + weighting + " AOF Anchored medial curve\n");
+        return computeAOFAnchoredMedialCurve<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+    }
+    if (isMedialSurfaceRequested(parser)) {
+        logger->Info("Running " + weighting + " medial surface\n");
+        return computeMedialSurface<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+    }
+    logger->Info("Running " + weighting + " medial curve\n");
+    return computeMedialCurve<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+}
 
-    //fs::path inputFilePath, rootPath, outputFolderPath;
 
-    using ObjectImageType = itk::Image<InputPixelType,Dimension>;
-    using FloatImageType = itk::Image<float, Dimension>;
+/// Coarse to fine: skeletonize the object downsampled by factor, map the coarse skeleton
+/// back to full resolution and dilate it into the band full resolution thinning is
+/// restricted to. The coarse pass keeps all end points (no AOF anchor), so the band
+/// covers every branch the full resolution pass may keep.
+template<typename ObjectImageType>
+static typename BandImage<ObjectImageType>::Pointer
+computePyramidBand(typename ObjectImageType::Pointer objectImage, double factor,
+                   itk::CommandLineArgumentParser::Pointer parser,
+                   itk::Logger::Pointer logger){
+    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
+    using BandImageType = BandImage<ObjectImageType>;
+    logger->Info("Pyramid: skeletonizing object downsampled by factor " + std::to_string(factor) + "\n");
+
+    auto coarseObject = resampleByFactor<ObjectImageType>(objectImage, factor, logger);
+    typename ObjectImageType::Pointer coarseSkeleton;
+    if (isMedialSurfaceRequested(parser)) {
+        using CoarseFilterType = itk::MedialSurfaceImageFilter<ObjectImageType, ObjectImageType>;
+        auto coarseFilter = CoarseFilterType::New();
+        coarseFilter->SetInput(coarseObject);
+        coarseFilter->SetRadiusWeightedSkeleton(false);
+        coarseFilter->Update();
+        coarseSkeleton = coarseFilter->GetOutput();
+    } else {
+        using CoarseFilterType = itk::MedialCurveImageFilter<ObjectImageType, ObjectImageType>;
+        auto coarseFilter = CoarseFilterType::New();
+        coarseFilter->SetInput(coarseObject);
+        coarseFilter->SetRadiusWeightedSkeleton(false);
+        coarseFilter->Update();
+        coarseSkeleton = coarseFilter->GetOutput();
+    }
+    auto upsampledSkeleton = resampleLike<ObjectImageType, ObjectImageType>(coarseSkeleton, objectImage, logger);
+
+    using ThresholdFilterType = itk::BinaryThresholdImageFilter<ObjectImageType, BandImageType>;
+    auto thresholdFilter = ThresholdFilterType::New();
+    thresholdFilter->SetInput(upsampledSkeleton);
+    thresholdFilter->SetLowerThreshold(itk::NumericTraits<typename ObjectImageType::PixelType>::OneValue());
+    thresholdFilter->SetUpperThreshold(itk::NumericTraits<typename ObjectImageType::PixelType>::max());
+    thresholdFilter->SetInsideValue(1);
+    thresholdFilter->SetOutsideValue(0);
+
+    // the full resolution medial locus is within about one coarse voxel of the coarse one.
+    unsigned bandRadius = static_cast<unsigned>(std::ceil(factor));
+    if(parser->GetCommandLineArgument("-band", bandRadius)){
+        logger->Info("Set pyramid band radius to " + std::to_string(bandRadius) + " voxels\n");
+    }else{
+        logger->Debug("Set pyramid band radius to default " + std::to_string(bandRadius) + " voxels\n");
+    }
+    using StructuringElementType = itk::BinaryBallStructuringElement<unsigned char, Dimension>;
+    StructuringElementType ball;
+    ball.SetRadius(bandRadius);
+    ball.CreateStructuringElement();
+
+    using DilateFilterType = itk::BinaryDilateImageFilter<BandImageType, BandImageType, StructuringElementType>;
+    auto dilateFilter = DilateFilterType::New();
+    dilateFilter->SetInput(thresholdFilter->GetOutput());
+    dilateFilter->SetKernel(ball);
+    dilateFilter->SetForegroundValue(1);
+    dilateFilter->Update();
+    return dilateFilter->GetOutput();
+}
 
-    using ReaderType = itk::ImageFileReader<ObjectImageType>;
-    auto reader = ReaderType::New();
-    reader->SetFileName(inputFileName);
 
-    std::vector<float> objectSpacing(Dimension,1);
-    if(parser->GetCommandLineArgument("-spacing",objectSpacing)){
-        logger->Debug("Read user spacing\n");
-    }else{
-        logger->Debug("Using default image spacing\n");
-    }
-
-    typename ObjectImageType::SpacingType spacing;
-    for(size_t d = 0 ; d < Dimension; ++d) {
-        spacing[d] = static_cast<typename ObjectImageType::SpacingValueType>(objectSpacing[d]);
-    }
-
-    std::stringstream ss;
-    ss << "Set input spacing : (";
-    for(size_t d = 0; d < Dimension; ++d) ss << spacing[d] << ",";
-    ss << ")\n";
-    logger->Info(ss.str());
-    ss.str("");
-
-    using InformationChangeFilterTypeFloat = itk::ChangeInformationImageFilter<ObjectImageType>;
-    auto changeSpacing = InformationChangeFilterTypeFloat::New();
-    changeSpacing->SetInput(reader->GetOutput());
-    changeSpacing->SetOutputSpacing(spacing);
-    changeSpacing->ChangeSpacingOn();
-    typename ObjectImageType::Pointer image = changeSpacing->GetOutput();
-
-    using GaussianFilterType = itk::DiscreteGaussianImageFilter<ObjectImageType , FloatImageType >;
-    typename GaussianFilterType::Pointer smoothingFilter = GaussianFilterType::New();
-    smoothingFilter->SetInput(image);
-    double smoothingVariance = 1;
-    if(parser->GetCommandLineArgument("-smooth",smoothingVariance)){
-        logger->Debug("Set smoothing variance to " + std::to_string(smoothingVariance) + "\n");
-    }else{
-        logger->Debug("Using default object smoothing variance to " + std::to_string(smoothingVariance) + "\n");
+/// Write skeleton, resampled to the geometry of inputObjectImage for previews and
+/// cropped to outputRegion (index space of inputObjectImage) unless it is empty.
+template<typename ObjectImageType, typename OutputImageType>
+static void
+writeSkeleton(typename OutputImageType::Pointer skeleton, typename ObjectImageType::Pointer inputObjectImage,
+              double previewFactor, const typename ObjectImageType::RegionType &outputRegion,
+              const std::string &fileName, itk::Logger::Pointer logger){
+    if(previewFactor > 1){
+        skeleton = resampleLike<OutputImageType, ObjectImageType>(skeleton, inputObjectImage, logger);
     }
-    std::vector<float> varVector(Dimension);
-    for(size_t d = 0; d < Dimension; ++d){
-        varVector[d] = smoothingVariance * spacing[d];
+    if(outputRegion.GetNumberOfPixels() > 0){
+        skeleton = extractRegion<OutputImageType>(skeleton, outputRegion);
     }
-
-    ss << "Set smoothing variance to : (";
-    for(size_t d = 0; d < Dimension; ++d) ss << varVector[d] << ",";
-    ss << ")\n";
-    logger->Info(ss.str());
-    ss.str("");
-    smoothingFilter->SetVariance(varVector.data());
-    smoothingFilter->SetUseImageSpacingOff();
+    writeImage<OutputImageType>(fileName, skeleton, logger);
+}
 
 
-    using ThresholdFilterType = itk::BinaryThresholdImageFilter< FloatImageType , ObjectImageType >;
-    typename ThresholdFilterType::Pointer thresholdFilter = ThresholdFilterType::New();
+/// Runs the selected skeletonization and writes the result to -output. With -cascade the
+/// medial surface is written to <output>_surface and thinned further into the medial curve,
+/// written to <output>_curve. The curve pass only visits surface voxels and reuses the
+/// distance, priority and AOF images of the surface pass.
+template<typename ObjectImageType, typename OutputImageType>
+static void
+runSkeletonization(typename ObjectImageType::Pointer objectImage,
+                   typename ObjectImageType::Pointer inputObjectImage,
+                   typename BandImage<ObjectImageType>::Pointer band,
+                   double previewFactor,
+                   const typename ObjectImageType::RegionType &outputRegion,
+                   itk::CommandLineArgumentParser::Pointer parser,
+                   itk::Logger::Pointer logger){
+    using OutputPixelType = typename OutputImageType::PixelType;
+    using PixelType = typename ObjectImageType::PixelType;
+    SharedFields<ObjectImageType::ImageDimension> fields;
 
-    double lthresh = 0.5;
-    if(parser->GetCommandLineArgument("-lthreshold", lthresh)){
-        logger->Debug("Set lower object threshold to : " + std::to_string(lthresh) + "\n");
-    }else{
-        logger->Debug("Set lower object threshold to default : " + std::to_string(lthresh) + "\n");
+    std::string outputFileName;
+    parser->GetCommandLineArgument("-output", outputFileName);
+    if (!parser->ArgumentExists("-cascade")) {
+        auto skeleton = computeSkeleton<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+        writeSkeleton<ObjectImageType, OutputImageType>(skeleton, inputObjectImage, previewFactor, outputRegion,
+                                                        outputFileName, logger);
+        return;
     }
-    thresholdFilter->SetLowerThreshold(lthresh);
 
-    double uthresh = std::numeric_limits<typename ThresholdFilterType::InputImageType::PixelType>::max();
-    if(parser->GetCommandLineArgument("-uthreshold", uthresh)){
-        logger->Debug("Set upper object threshold to : " + std::to_string(uthresh) + "\n");
-    }else{
-        logger->Debug("Set upper object threshold to default : " + std::to_string(uthresh) + "\n");
+    fs::path outputFilePath(outputFileName);
+    fs::path surfaceFilePath = outputFilePath.parent_path() / (outputFilePath.stem().string() + "_surface" +
+                                                                outputFilePath.extension().string());
+    fs::path curveFilePath = outputFilePath.parent_path() / (outputFilePath.stem().string() + "_curve" +
+                                                              outputFilePath.extension().string());
+    std::string anchorType;
+    parser->GetCommandLineArgument("-anchor", anchorType);
+    bool anchored = anchorType == "aof";
+
+    logger->Info("Cascade: computing medial surface\n");
+    typename OutputImageType::Pointer surface;
+    if (anchored) {
+        surface = computeAOFAnchoredMedialSurface<ObjectImageType, OutputImageType>(objectImage, band, fields,
+                                                                                    parser, logger);
+    } else {
+        surface = computeMedialSurface<ObjectImageType, OutputImageType>(objectImage, band, fields, parser, logger);
+    }
+    writeSkeleton<ObjectImageType, OutputImageType>(surface, inputObjectImage, previewFactor, outputRegion,
+                                                    surfaceFilePath.string(), logger);
+
+    // surface voxels are the object of the curve pass, weights come from the shared distance.
+    using SurfaceObjectFilterType = itk::BinaryThresholdImageFilter<OutputImageType, ObjectImageType>;
+    auto surfaceObjectFilter = SurfaceObjectFilterType::New();
+    surfaceObjectFilter->SetInput(surface);
+    surfaceObjectFilter->SetLowerThreshold(itk::NumericTraits<OutputPixelType>::ZeroValue());
+    surfaceObjectFilter->SetUpperThreshold(itk::NumericTraits<OutputPixelType>::ZeroValue());
+    surfaceObjectFilter->SetInsideValue(itk::NumericTraits<PixelType>::ZeroValue());
+    surfaceObjectFilter->SetOutsideValue(itk::NumericTraits<PixelType>::OneValue());
+    surfaceObjectFilter->Update();
+    typename ObjectImageType::Pointer surfaceObject = surfaceObjectFilter->GetOutput();
+
+    logger->Info("Cascade: thinning medial surface to medial curve\n");
+    typename OutputImageType::Pointer curve;
+    if (anchored) {
+        curve = computeAOFAnchoredMedialCurve<ObjectImageType, OutputImageType>(surfaceObject, nullptr, fields,
+                                                                                parser, logger, "-curveThreshold");
+    } else {
+        curve = computeMedialCurve<ObjectImageType, OutputImageType>(surfaceObject, nullptr, fields, parser, logger);
     }
+    writeSkeleton<ObjectImageType, OutputImageType>(curve, inputObjectImage, previewFactor, outputRegion,
+                                                    curveFilePath.string(), logger);
+}
 
-    thresholdFilter->SetUpperThreshold(uthresh);
-    InputPixelType objectInsideValue = itk::NumericTraits<InputPixelType>::OneValue();
-    InputPixelType objectOutsideValue = itk::NumericTraits<InputPixelType>::ZeroValue();
 
-    thresholdFilter->SetOutsideValue(objectOutsideValue);
-    thresholdFilter->SetInsideValue(objectInsideValue);
-    thresholdFilter->SetInput(smoothingFilter->GetOutput());
-    typename ObjectImageType::Pointer objectImage;
+/// Object to skeletonize from readRegion of fileName (all of it if empty): smoothed, thresholded
+/// and (-fillholes) hole filled.
+template<typename ObjectImageType>
+static typename ObjectImageType::Pointer
+buildObjectImage(const std::string &fileName,
+                 const typename ObjectImageType::RegionType &readRegion,
+                 itk::CommandLineArgumentParser::Pointer parser,
+                 itk::Logger::Pointer logger){
+    using FloatImageType = itk::Image<float, ObjectImageType::ImageDimension>;
+    using PixelType = typename ObjectImageType::PixelType;
+    typename ObjectImageType::Pointer thresholdedImage =
+            computeObjectImage<ObjectImageType, FloatImageType>(fileName, readRegion, parser, logger);
     if(parser->ArgumentExists("-fillholes")){
         logger->Info("Filling holes in the object\n");
         using HoleFillingFilterType = itk::BinaryFillholeImageFilter<ObjectImageType>;
         typename HoleFillingFilterType::Pointer filledFilter = HoleFillingFilterType::New();
-        filledFilter->SetInput(thresholdFilter->GetOutput());
-        filledFilter->SetForegroundValue(objectInsideValue);
+        filledFilter->SetInput(thresholdedImage);
+        filledFilter->SetForegroundValue(itk::NumericTraits<PixelType>::OneValue());
         filledFilter->Update();
-        objectImage = filledFilter->GetOutput();
-    }else{
-        logger->Info("Using smoothed object without hole filling\n");
-        objectImage = thresholdFilter->GetOutput();
+        return filledFilter->GetOutput();
     }
-    objectImage->Update();
+    logger->Info("Using smoothed object without hole filling\n");
+    return thresholdedImage;
+}
+
+
+/// -timeseries: every -input file is a frame. The first frame is skeletonized from scratch.
+/// For the next ones only the bounding box of changed object voxels is processed: distance
+/// and AOF are recomputed around it (see updateSignedDistanceAOF) and the object is re-thinned
+/// in the box where they changed, padded by -changeMargin voxels (default 2). Outside the box
+/// the previous skeleton is kept, a protected shell of it closes the box during re-thinning.
+template<typename ObjectImageType, typename OutputImageType>
+static int
+runTimeSeries(itk::CommandLineArgumentParser::Pointer parser,
+              itk::Logger::Pointer logger){
+    constexpr unsigned Dimension = ObjectImageType::ImageDimension;
+    using FloatImageType = itk::Image<float, Dimension>;
+    using MaskImageType = itk::Image<unsigned char, Dimension>;
+    using RegionType = typename ObjectImageType::RegionType;
+    using PixelType = typename ObjectImageType::PixelType;
+    using ScaleFilterType = itk::MultiplyImageFilter<FloatImageType, FloatImageType, FloatImageType>;
+
+    std::vector<std::string> inputFileNames;
+    parser->GetCommandLineArgument("-input", inputFileNames);
+    std::string outputFileName;
+    parser->GetCommandLineArgument("-output", outputFileName);
+    fs::path outputFilePath(outputFileName);
 
     std::string anchorType;
     parser->GetCommandLineArgument("-anchor", anchorType);
-    if (anchorType == "aof") {
-        if (parser->ArgumentExists("-weighted")) {
-			if (parser->ArgumentExists("-surface")){
-				logger->Info("Running radius weighted AOF Anchored medial surface\n");
-				computeAOFAnchoredMedialSurface<ObjectImageType, FloatImageType>(objectImage, parser, logger);
-			}else{
-				logger->Info("Running radius weighted AOF Anchored medial curve\n");
-				computeAOFAnchoredMedialCurve<ObjectImageType, FloatImageType>(objectImage, parser, logger);
-			}
+    const bool anchored = anchorType == "aof";
+
+    unsigned changeMargin = 2;
+    parser->GetCommandLineArgument("-changeMargin", changeMargin);
+
+    // inside positive distance, used for priority and radius weights.
+    auto depthOf = [](typename FloatImageType::Pointer signedDistance){
+        auto inverter = ScaleFilterType::New();
+        inverter->SetInput(signedDistance);
+        inverter->SetConstant(-1);
+        inverter->Update();
+        return typename FloatImageType::Pointer(inverter->GetOutput());
+    };
+
+    typename ObjectImageType::Pointer previousObject;
+    typename FloatImageType::Pointer signedDistance;
+    typename FloatImageType::Pointer aof;
+    typename OutputImageType::Pointer skeleton;
+    for (size_t frame = 0; frame < inputFileNames.size(); ++frame) {
+        logger->Info("Time series frame " + std::to_string(frame) + " : " + inputFileNames[frame] + "\n");
+        auto objectImage = buildObjectImage<ObjectImageType>(inputFileNames[frame], RegionType(),
+                                                            parser, logger);
+
+        RegionType changed;
+        if (frame == 0) {
+            if (anchored) {
+                auto distanceAOF =
+                        computeObjectSignedDistanceAOFPair<ObjectImageType, FloatImageType>(objectImage, parser, logger);
+                signedDistance = distanceAOF.first;
+                aof = distanceAOF.second;
+            } else {
+                signedDistance = computeObjectSignedDistanceSpokesPair<ObjectImageType, FloatImageType>(
+                        objectImage, logger).first;
+            }
+            SharedFields<Dimension> fields;
+            fields.distance = fields.priority = depthOf(signedDistance);
+            fields.aof = aof;
+            skeleton = computeSkeleton<ObjectImageType, OutputImageType>(objectImage, nullptr, fields, parser, logger);
+        } else if (!computeChangedRegion<ObjectImageType>(previousObject, objectImage, changed)) {
+            logger->Info("Frame unchanged, reusing previous skeleton\n");
         } else {
-			if(parser->ArgumentExists("-curve")){
-				logger->Info("Running unweighted AOF Anchored medial curve\n");
-				computeAOFAnchoredMedialCurve<ObjectImageType, ObjectImageType>(objectImage, parser, logger);
-			}else{
-				logger->Info("Running unweighted AOF Anchored medial surface\n");
-				computeAOFAnchoredMedialSurface<ObjectImageType, ObjectImageType>(objectImage, parser, logger);
-			}
+            auto largest = objectImage->GetLargestPossibleRegion();
+            RegionType influence = updateSignedDistanceAOF<ObjectImageType, FloatImageType>(
+                    objectImage, changed, signedDistance, aof, parser, logger);
+            influence.PadByRadius(changeMargin);
+            influence.Crop(largest);
+            RegionType crop = influence;
+            crop.PadByRadius(2);
+            crop.Crop(largest);
+            logger->Info("Re-thinning " + std::to_string(crop.GetNumberOfPixels()) + " of " +
+                         std::to_string(largest.GetNumberOfPixels()) + " voxels\n");
+
+            // new object inside the influence box, protected previous skeleton around it.
+            auto cropObject = extractRegion<ObjectImageType>(objectImage, crop);
+            auto protectedVoxels = MaskImageType::New();
+            protectedVoxels->CopyInformation(cropObject);
+            protectedVoxels->SetRegions(cropObject->GetLargestPossibleRegion());
+            protectedVoxels->Allocate();
+            protectedVoxels->FillBuffer(0);
+            itk::ImageRegionIteratorWithIndex<ObjectImageType> oit(cropObject, cropObject->GetLargestPossibleRegion());
+            for (oit.GoToBegin(); !oit.IsAtEnd(); ++oit) {
+                auto index = oit.GetIndex();
+                for (unsigned d = 0; d < Dimension; ++d) index[d] += crop.GetIndex(d);
+                if (influence.IsInside(index)) continue;
+                bool kept = skeleton->GetPixel(index) > 0;
+                oit.Set(kept ? itk::NumericTraits<PixelType>::OneValue() : itk::NumericTraits<PixelType>::ZeroValue());
+                protectedVoxels->SetPixel(oit.GetIndex(), kept ? 1 : 0);
+            }
+
+            SharedFields<Dimension> fields;
+            fields.distance = fields.priority = depthOf(extractRegion<FloatImageType>(signedDistance, crop));
+            if (anchored) fields.aof = extractRegion<FloatImageType>(aof, crop);
+            fields.protectedVoxels = protectedVoxels;
+            auto cropSkeleton = computeSkeleton<ObjectImageType, OutputImageType>(cropObject, nullptr, fields,
+                                                                                 parser, logger);
+            RegionType pasted = influence;
+            for (unsigned d = 0; d < Dimension; ++d) pasted.SetIndex(d, influence.GetIndex(d) - crop.GetIndex(d));
+            pasteRegion<OutputImageType>(skeleton, cropSkeleton, pasted, influence.GetIndex());
         }
 
+        fs::path frameFilePath = outputFilePath.parent_path() / (outputFilePath.stem().string() + "_t" +
+                                                                  int_to_string(frame) +
+                                                                  outputFilePath.extension().string());
+        writeImage<OutputImageType>(frameFilePath.string(), skeleton, logger);
+        previousObject = objectImage;
     }
-    else {
+    return EXIT_SUCCESS;
+}
+
+
+template <typename InputPixelType, unsigned int Dimension>
+int skeletonize_impl(const itk::CommandLineArgumentParser::Pointer &parser,
+                    const itk::Logger::Pointer &logger) {
+
+    logger->Info("Skeltoniation module\n");
+
+    //fs::path inputFilePath, rootPath, outputFolderPath;
+
+    using ObjectImageType = itk::Image<InputPixelType,Dimension>;
+    using FloatImageType = itk::Image<float, Dimension>;
+
+    if (parser->ArgumentExists("-timeseries")) {
         if (parser->ArgumentExists("-weighted")) {
-			if(parser->ArgumentExists("-surface")){
-				logger->Info("Running radius weighted medial surface\n");
-				computeMedialSurface<ObjectImageType, FloatImageType>(objectImage, parser, logger);
-			}else{
-				logger->Info("Running radius weighted medial curve\n");
-				computeMedialCurve<ObjectImageType, FloatImageType>(objectImage, parser, logger);
-			}
-        } else {
-			if(parser->ArgumentExists("-surface")){
-				logger->Info("Running unweighted medial surface\n");
-				computeMedialCurve<ObjectImageType, ObjectImageType>(objectImage, parser, logger);
-			}else{
-				logger->Info("Running unweighted medial curve\n");
-				computeMedialSurface<ObjectImageType, ObjectImageType>(objectImage, parser, logger);
-			}
+            return runTimeSeries<ObjectImageType, FloatImageType>(parser, logger);
+        }
+        return runTimeSeries<ObjectImageType, ObjectImageType>(parser, logger);
+    }
+
+    std::string inputFileName;
+    parser->GetCommandLineArgument("-input", inputFileName);
+    // -roi: only the region of interest plus a halo is read, the skeleton is cropped back to it.
+    using RegionType = typename ObjectImageType::RegionType;
+    RegionType roi, outputRegion;
+    typename ObjectImageType::Pointer objectImage;
+    if (getRegionOfInterest<ObjectImageType>(inputFileName, parser, logger, roi)) {
+        double smoothingVariance = 1;
+        parser->GetCommandLineArgument("-smooth", smoothingVariance);
+        std::vector<float> objectSpacing(Dimension, 1);
+        parser->GetCommandLineArgument("-spacing", objectSpacing);
+        float maxSpacing = *std::max_element(objectSpacing.begin(), objectSpacing.end());
+        auto buildObject = [&](const RegionType &readRegion) {
+            return buildObjectImage<ObjectImageType>(inputFileName, readRegion, parser, logger);
+        };
+        objectImage = computeObjectWithHalo<ObjectImageType>(inputFileName, roi,
+                                                             smoothingHalo(smoothingVariance * maxSpacing),
+                                                             buildObject, logger, outputRegion);
+    } else {
+        objectImage = buildObjectImage<ObjectImageType>(inputFileName, RegionType(), parser, logger);
+    }
+
+    typename ObjectImageType::Pointer inputObjectImage = objectImage;
+    double previewFactor = getPreviewFactor(parser, logger);
+    if(previewFactor > 1){
+        objectImage = resampleByFactor<ObjectImageType>(objectImage, previewFactor, logger);
+    }
+
+    typename BandImage<ObjectImageType>::Pointer band = nullptr;
+    double pyramidFactor = 1;
+    if(parser->GetCommandLineArgument("-pyramid", pyramidFactor)){
+        if(pyramidFactor > 1){
+            band = computePyramidBand<ObjectImageType>(objectImage, pyramidFactor, parser, logger);
+        }else{
+            logger->Warning("Ignoring pyramid factor " + std::to_string(pyramidFactor) + " <= 1\n");
         }
     }
+
+    if (parser->ArgumentExists("-weighted")) {
+        runSkeletonization<ObjectImageType, FloatImageType>(objectImage, inputObjectImage, band,
+                                                            previewFactor, outputRegion, parser, logger);
+    } else {
+        runSkeletonization<ObjectImageType, ObjectImageType>(objectImage, inputObjectImage, band,
+                                                             previewFactor, outputRegion, parser, logger);
+    }
     return EXIT_SUCCESS;
 }
 